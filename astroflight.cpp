@@ -11,6 +11,9 @@
 #include "game_objects.hpp"
 #include "level.hpp"
 #include "gui.hpp"
+#include "channels.hpp"	// Hand-over between simulation and render thread
+#include "trajectory_worker.hpp"	// Trajectory prediction on a background thread
+#include "auto_aim.hpp"		// Launch solver
 
 // Debug console output
 #include <iostream>	
@@ -22,6 +25,11 @@
 #include <vector>
 #include <algorithm>
 
+// Simulation thread
+#include <thread>
+#include <atomic>
+#include <chrono>
+
 #if __has_include(<filesystem>)
 #include <filesystem>
 #elif __has_include(<experimental/filesystem>)
@@ -36,31 +44,43 @@ const GLuint SCR_WIDTH = 1280;		// Default window width
 const GLuint SCR_HEIGHT = 720;		// Default window height
 const glm::mat4 projection = glm::ortho(0.0f, (float)SCR_WIDTH, 0.0f, (float)SCR_HEIGHT);
 
-// OpenGL seems to behave differently on UNIX / Windows
-#ifdef _WIN32
-float physicsFPS = 60.0f;		// Updates per second. 60 ensures fluent visuals, higher values increase game speed
-#else
-float physicsFPS = 120.0f;
-#endif
-
-float speedMultiplicator = 1.0f;
+// Game time advances in fixed ticks independent of platform and frame rate
+const double ticksPerSecond = 120.0;		// Game ticks per second at normal speed, velocities are in units per tick
+const unsigned int maxTicksPerBatch = 16;	// Caps the catch-up after slow batches (per 1x of warp), the rest of the backlog is dropped
+const double physicsBudget = 0.010;			// Seconds of physics per batch before the time warp is lowered
+
+// Time warp
+const float warpLevels[] = { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 10.0f, 25.0f, 50.0f, 100.0f };
+const unsigned int nWarpLevels = sizeof(warpLevels) / sizeof(warpLevels[0]);
+unsigned int warpLevel = 2;
+float speedMultiplicator = 1.0f;	// Selected game speed
+float timeWarp = 1.0f;				// Achieved game speed, lower than selected if the physics can't keep up
 const unsigned int maxBoxes = 3;
+const unsigned int trajectoryTicks = 2000;			// Integrated trajectory preview in game ticks
+const unsigned int longTrajectoryTicks = 20000;		// Long preview, extended with patched conics
+const unsigned int trajectoryStepBudget = 256;		// Trajectory steps per slice, the preview grows over several
+const double autoAimBudget = 0.002;					// Seconds of launch search per simulation loop
 
-// Mouse and window positions
+// The simulation thread owns the level and all game state below, the render thread (main) owns the
+// window, the GUI and everything marked as render state. They only meet in the snapshots and the input queue.
+
+// Mouse and window positions (render state)
 int windowX, windowY;				// Last window position before switching to fullscreen mode
 double cursorX, cursorY;			// Last cursor position upon left click
 
 // Flags
-bool windowed = true;
-bool wireframe = false;
-bool clicked = false;
+bool windowed = true;				// Render state
+bool wireframe = false;				// Render state
+bool showFPS = false;				// Render state
+bool gui = true;					// Render state
 bool drawTrajectory = false;
+bool longTrajectory = false;
+bool drawEnsemble = false;			// Uncertainty band around the trajectory
+bool autoAim = false;				// Launch solver
 bool nextLevel = false;
 bool restartLevel = false;
-bool showFPS = false;
 bool showCOM = false;				// Center of Mass
 bool showGradient = false;			// Gravity gradient
-bool createdGradient = false;
 bool turnLeft = false;
 bool turnRight = false;
 bool increaseSpeed = false;
@@ -71,7 +91,6 @@ bool gameOver = false;
 bool gameWon = false;
 bool signalLost = false;
 bool pause = true;
-bool gui = true;
 int precisionMode = 0;
 
 // Selected object for gravity field
@@ -84,21 +103,74 @@ std::vector<std::string> levelList;
 unsigned int levelID = 0;
 
 // Tick rate management
-float physicsTickRate = 1.0f / physicsFPS;			// Physics updates per second
-unsigned int frameCount = 0;						// Frames per second
-double currentTime = glfwGetTime();					// For measuring time intervals
-double lastSecond = currentTime;					// Update every second to measure FPS
-double lastTick = currentTime;						// Update every tick
-double outOfBounds = 0.0f;							// Measures how long player has been outside the window
-int counter = 0;
+unsigned int tickCount = 0;							// Physics steps per second
+unsigned int droppedTicks = 0;						// Steps skipped by the catch-up cap in the last second
+unsigned int caughtUpTicks = 0;						// Steps beyond the first in a batch in the last second
+double accumulator = 0.0;							// Game time in seconds not yet simulated
+float outOfBounds = 0.0f;							// Game ticks the player has spent outside the window, counted per physics step
+unsigned int levelCount = 0;						// Number of levels loaded, tells the render thread to renew the stars
 
 // Gravity gradient density
 const int xCount = 160;
 const int yCount = 90;
+const unsigned int gradientStaleness = 4;			// Updates until the whole gradient follows moving bodies
 
 // GUI
 unsigned int speedCountdown = 0;
-int currentFPS = 0;
+int currentTicks = 0;
+unsigned int frameCount = 0;						// Frames per second (render state)
+int currentFPS = 0;									// Render state
+
+// Input forwarded from the GLFW callbacks to the simulation thread
+struct InputEvent
+{
+	bool click;			// Left mouse button, otherwise a key
+	int key;
+	int action;
+	double x, y;		// Cursor position of a click in screen coordinates
+};
+SpscQueue<InputEvent, 256> inputQueue;
+
+// Everything the render thread needs to draw one physics state
+// ------------------------------------------------------------
+struct Snapshot
+{
+	Level level;
+	SpaceShip player;
+	Flag flag;
+	CenterOfMass centerOfMass;
+	GravGradient gravGradient;
+	unsigned int levelCount = 0;
+	unsigned int trajectoryGeneration = 0;	// Level the trajectory has to belong to, see TrajectoryWorker
+
+	bool drawTrajectory = false;
+	bool drawEnsemble = false;
+	AutoAim::State aimState = AutoAim::IDLE;
+	bool showCOM = false;
+	bool showGradient = false;
+	bool pause = true;
+	bool gameOver = false;
+	bool gameWon = false;
+	bool signalLost = false;
+	bool outOfBounds = false;
+	int counter = 0;
+	int planetID = -1;
+	int moonID = -1;
+	int blackHoleID = -1;
+	float speedMultiplicator = 1.0f;
+	float timeWarp = 1.0f;
+	unsigned int speedCountdown = 0;
+	int currentTicks = 0;
+
+	// Interpolation: game time since the last step at the moment of publishing
+	double time = 0.0;
+	double accumulator = 0.0;
+	double stepDuration = 1.0;
+
+	Snapshot(const Level& level, const SpaceShip& player, const Flag& flag)
+		: level(level), player(player), flag(flag)
+	{}
+};
 
 
 // GLFW: Callback function for window size
@@ -167,10 +239,37 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 	if (key == GLFW_KEY_G && action == GLFW_PRESS)
 		gui = !gui;
 
+	// Toggle FPS counter with D
+	if (key == GLFW_KEY_D && action == GLFW_PRESS)
+		showFPS = !showFPS;
+
+	// Everything else changes the game and is handled by the simulation thread
+	if (!inputQueue.push(InputEvent{ false, key, action, 0.0, 0.0 }))
+		std::cout << "Error: Input queue full, key dropped" << std::endl;
+}
+
+// Game inputs forwarded by keyCallback, runs on the simulation thread
+// --------------------------------------------------------------------
+void handleKey(int key, int action)
+{
 	// Toggle trajectory with T
 	if (key == GLFW_KEY_T && action == GLFW_PRESS)
 		drawTrajectory = !drawTrajectory;
 
+	// Toggle long trajectory preview with L
+	if (key == GLFW_KEY_L && action == GLFW_PRESS)
+		longTrajectory = !longTrajectory;
+
+	// Toggle uncertainty band of the trajectory with E
+	if (key == GLFW_KEY_E && action == GLFW_PRESS)
+		drawEnsemble = !drawEnsemble;
+
+	// Toggle the launch solver with A, aiming by hand turns it off
+	if (key == GLFW_KEY_A && action == GLFW_PRESS)
+		autoAim = !autoAim;
+	if ((key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT || key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) && action == GLFW_PRESS)
+		autoAim = false;
+
 	// Toggle center of mass with C
 	if (key == GLFW_KEY_C && action == GLFW_PRESS)
 		showCOM = !showCOM;
@@ -190,27 +289,21 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		restartLevel = true;
 	}
 
-	// Toggle FPS counter with D
-	if (key == GLFW_KEY_D && action == GLFW_PRESS)
-		showFPS = !showFPS;
-
 	// Pause game with P
 	if (key == GLFW_KEY_P && action == GLFW_PRESS)
 		pause = !pause;
 
 	// Change game speed
-	if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS && speedMultiplicator < 4.0f)
+	if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS && warpLevel + 1 < nWarpLevels)
 	{
-		speedMultiplicator *= 2.0f;
-		physicsFPS *= 2.0f;
-		physicsTickRate = 1.0f / physicsFPS;
+		speedMultiplicator = warpLevels[++warpLevel];
+		timeWarp = speedMultiplicator;
 		speedCountdown = 2;
 	}
-	if (key == GLFW_KEY_SLASH && action == GLFW_PRESS && speedMultiplicator > 0.25f)
+	if (key == GLFW_KEY_SLASH && action == GLFW_PRESS && warpLevel > 0)
 	{
-		speedMultiplicator *= 0.5f;
-		physicsFPS *= 0.5f;
-		physicsTickRate = 1.0f / physicsFPS;
+		speedMultiplicator = warpLevels[--warpLevel];
+		timeWarp = speedMultiplicator;
 		speedCountdown = 2;
 	}
 
@@ -252,16 +345,17 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 		cursorX *= (float)SCR_WIDTH / (float)width;
 		cursorY *= (float)SCR_HEIGHT / (float)height;
 
-		clicked = true;
+		if (!inputQueue.push(InputEvent{ true, 0, action, cursorX, cursorY }))
+			std::cout << "Error: Input queue full, click dropped" << std::endl;
 	}
 }
 
 // Toggle gravity fields of planets/moons upon left mouse click
-void toggleFields(Level level)
+void toggleFields(Level& level, const glm::vec2 cursor)
 {
-	glm::vec2 cursorPos = glm::vec2(cursorX, SCR_HEIGHT - cursorY);
+	glm::vec2 cursorPos = glm::vec2(cursor.x, SCR_HEIGHT - cursor.y);
 
-	std::vector<Planet> planets(level.getPlanets());
+	std::vector<Planet>& planets = level.getPlanets();
 	for (unsigned int i = 0; i < planets.size(); ++i)
 	{
 		if (glm::distance(planets[i].getPosition(), cursorPos) <= planets[i].getRadius())
@@ -278,7 +372,7 @@ void toggleFields(Level level)
 		}
 	}
 
-	std::vector<Moon> moons(level.getMoons());
+	std::vector<Moon>& moons = level.getMoons();
 	for (unsigned int i = 0; i < moons.size(); ++i)
 	{
 		if (glm::distance(moons[i].getPosition(), cursorPos) <= moons[i].getRadius())
@@ -295,7 +389,7 @@ void toggleFields(Level level)
 		}
 	}
 
-	std::vector<BlackHole> blackHoles(level.getBlackHoles());
+	std::vector<BlackHole>& blackHoles = level.getBlackHoles();
 	for (unsigned int i = 0; i < blackHoles.size(); ++i)
 	{
 		if (glm::distance(blackHoles[i].getPosition(), cursorPos) <= blackHoles[i].getRadius())
@@ -477,139 +571,56 @@ void drawStars(const std::vector<Star>& stars, const Shader& shader)
 	glDeleteBuffers(1, &VBO);
 }
 
-
-int main(int argc, char * argv[])
+// Game speed for the GUI, e.g. "0.25x", "2x", "100x"
+// ---------------------------------------------------
+std::string formatSpeed(const float speed)
 {
-	// Load level list
-	// ---------------
-	if (argc == 1)
-		levelList = loadLevelList();
-	else
-		levelList = loadLevelList(argv[1]);
+	std::string text = std::to_string(speed);
+	text = text.substr(0, speed < 1.0f ? 4 : text.find('.'));
+	return text.append("x");
+}
 
-	std::cout << "Loaded levels: " << levelList.size() << std::endl;
-	for (auto name  : levelList)
-	{
-		std::cout << name << std::endl;
-	}
 
-	if (levelList.size() == 0)
-	{
-		std::cout << "Directory 'level' must contain at least 1 valid level with file extension '.lvl'\n";
-		std::cout << "Press Enter to exit";
-		std::cin >> argv[0];
-		return 0;
-	}
-
-	Level level = loadLevelByName(levelList[levelID]);
-	std::cout << "Loading level: " << level.getName() << std::endl;
-	level.genPhysics();
-	SpaceShip player(level.getPlanets()[0]);
-	Trajectory trajectory(player, level.getPhysics(), 2000);
-	CenterOfMass centerOfMass;
-	GravGradient gravGradient;
-	gravGradient.update(SCR_WIDTH, SCR_HEIGHT, xCount, yCount, level.getPhysics());
-	Flag flag(level.getPlanets()[1]);
-	std::vector<Star> stars = generateStars();
+// Simulation thread: applies inputs, runs the physics in fixed steps and publishes snapshots
+// The level and all objects passed in belong to this thread until running turns false
+// ------------------------------------------------------------------------------------------
+void simulate(Level& level, SpaceShip& player, TrajectoryWorker& trajectory, Flag& flag, CenterOfMass& centerOfMass, GravGradient& gravGradient, TripleBuffer<Snapshot>& snapshots, const std::atomic<bool>& running)
+{
+	double currentTime = glfwGetTime();
+	double lastSecond = currentTime;
+	double lastBatch = currentTime;
 	glm::vec2 playerPosition = player.getPosition();
+	InputEvent input;
+	AutoAim solver(trajectoryTicks);
 
-	// GLFW: Setup
-	// -----------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	glfwWindowHint(GLFW_SAMPLES, 4);
-
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-	//  Window creation
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "AstroFlight", NULL, NULL);
-	if (window == NULL)
+	while (running)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
-	}
-	glfwMakeContextCurrent(window);
-	glfwGetWindowPos(window, &windowX, &windowY);
-
-	// Setting callback functions
-	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
-	glfwSetWindowPosCallback(window, windowPosCallback);
-	glfwSetKeyCallback(window, keyCallback);
-	glfwSetMouseButtonCallback(window, mouseButtonCallback);
-
-
-	// GLAD: loading OpenGL function pointers
-	// --------------------------------------
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
-	}
-
-	// Enabling z-buffer and blending
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glLineWidth(2);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_MULTISAMPLE);
-
-
-	// Building necessary shader programs
-	// ----------------------------------
-	Shader shaderSimple = addShader("vDefault", "fSimple");			// Black holes, space ship, trajectory
-	Shader shaderLighting = addShader("vDefault", "fLighting");		// Planets, moons
-	Shader shaderField = addShader("vDefault", "fGravField");		// Gravitational fields
-	Shader shaderAtmosphere = addShader("vDefault", "fAtmosphere");	// Atmosphere of planets and moons
-	Shader shaderGradient = addShader("vDefault", "fGradient");		// Stars, center of mass and event horizon of black holes
-	Shader shaderGravGradient = addShader("vOutColor", "fInColor");	// Gravity gradient
-	Shader shaderText = addShader("vText", "fText");				// GUI text
-	Shader shaderBox = addShader("vGUI", "fAlpha");					// GUI text box
-
-	// Lighting setup
-	shaderLighting.use();
-	shaderLighting.setVec3("light.color", glm::vec3(255, 255, 255));
-	shaderLighting.setVec3("light.direction", glm::vec3(1.0f, -1.0f, 0.0f));
-
-	// Loading GUI
-	GUI::textInit();
-	std::string guiGameSpeed, guiLaunchSpeed, guiLaunchAngle, guiLevelName, guiScore, guiGameOver, guiMass, guiFPS;
-	GLuint infoBoxAddonsX = level.getName().length();
-	GLuint infoBoxAddonsY = 1;
-	GLuint counterOffset = 0;
-	glm::vec3 guiTextColor = glm::vec3(0.5f, 0.8f, 0.2f);
-	glm::vec4 guiBoxColor = glm::vec4(0.0f, 0.0f, 0.0f, 0.3f);
-
-	// Game loop
-	// -----------
-	while (!glfwWindowShouldClose(window))
-	{	
 		currentTime = glfwGetTime();
 
 		// Executes once per second
 		if (currentTime - lastSecond >= 1.0f)
 		{
 			lastSecond = currentTime;
-			currentFPS = frameCount;
-			frameCount = 0;
+			currentTicks = tickCount;
+			tickCount = 0;
+			if (droppedTicks)
+				std::cout << "Physics too slow, ticks last second: " << currentTicks << " (" << caughtUpTicks << " caught up, " << droppedTicks << " dropped)" << std::endl;
+			droppedTicks = 0;
+			caughtUpTicks = 0;
 			if (speedCountdown)
 				--speedCountdown;
 		}
-		else
-			++frameCount;
 
 
 		// Handle inputs
-		if (clicked)
+		bool changed = false;
+		while (inputQueue.pop(input))
 		{
-			toggleFields(level);
-			clicked = false;
+			changed = true;
+			if (input.click)
+				toggleFields(level, glm::vec2(input.x, input.y));
+			else
+				handleKey(input.key, input.action);
 		}
 			
 		if (nextLevel)
@@ -622,25 +633,33 @@ int main(int argc, char * argv[])
 			{
 				changeLevel(level);
 				drawTrajectory = false;
-				stars = generateStars();
+				++levelCount;
 			}
 			level.genPhysics();
 			player.setPlanet(level.getPlanets()[0], true);
 			flag.setPlanet(level.getPlanets()[1]);
-			trajectory.setPointMassPointer(level.getPhysics());
-			trajectory.update();
-			createdGradient = false;
+			trajectory.setLevel(level);
+			trajectory.post(level, player, longTrajectory ? longTrajectoryTicks : trajectoryTicks, drawEnsemble);
+			solver.stop();
 			pause = true;
 			nextLevel = false;
 			restartLevel = false;
+			accumulator = 0.0;				// Loading time is not game time
+			lastBatch = glfwGetTime();
 			gameOver = false;
 			gameWon = false;
 			signalLost = false;
+			outOfBounds = 0.0f;
 			planetID = -1;
 			moonID = -1;
 			blackHoleID = -1;
 		}
 
+		if (autoAim && solver.getState() == AutoAim::IDLE)
+			solver.start(player, level);
+		else if (!autoAim)
+			solver.stop();
+
 		if (launch)
 		{
 			pause = false;
@@ -650,7 +669,7 @@ int main(int argc, char * argv[])
 			else if (player.getLaunchState() < 4)
 			{
 				if (level.getBoxes().size() < maxBoxes)
-					level.getBoxes().push_back(Box(player, level.getPhysics()));
+					level.getBoxes().push_back(Box(player, level.getBodies(), level.getIntegration()));
 			}
 				
 			launch = false;
@@ -673,26 +692,45 @@ int main(int argc, char * argv[])
 		}
 
 
-		// Move objects
-		if (currentTime - lastTick > physicsTickRate)
+		// Move objects in fixed steps of timeStep game ticks until the game time since the last batch is used up
+		// Under time warp the steps run back to back, trajectory and gradient updates happen once per batch
+		accumulator += (currentTime - lastBatch) * timeWarp;
+		lastBatch = currentTime;
+		const double stepDuration = level.getIntegration().timeStep / ticksPerSecond;
+		const unsigned int maxTicks = maxTicksPerBatch * (unsigned int)std::ceil(std::max(1.0f, timeWarp));
+		unsigned int batchTicks = 0;
+		bool overBudget = false;
+
+		while (accumulator >= stepDuration)
 		{
-			lastTick = currentTime;
+			// Spiral of death: slow frames would need ever more steps, drop the backlog instead
+			// The clock is only read every 8 steps to keep it out of the batch
+			if (timeWarp > 1.0f && batchTicks % 8 == 0 && glfwGetTime() - currentTime > physicsBudget)
+				overBudget = true;
+			if (batchTicks == maxTicks || overBudget)
+			{
+				droppedTicks += (unsigned int)(accumulator / stepDuration);
+				accumulator = std::fmod(accumulator, stepDuration);
+				break;
+			}
+			accumulator -= stepDuration;
+			++batchTicks;
+
+			level.saveState();
+			player.saveState();
+			flag.saveState();
 
 			if (turnLeft)
-				player.rotate(false, precisionMode);
+				player.rotate(false, precisionMode, level.getIntegration().timeStep);
 			if (turnRight)
-				player.rotate(true, precisionMode);
+				player.rotate(true, precisionMode, level.getIntegration().timeStep);
 
 			if (!pause)
 				level.updatePhysics();
 			if (!gameOver && !pause || player.getLaunchState() == 0)
-				player.move(level.getPhysics());
-			if (player.getLaunchState() == 0 && drawTrajectory)
-				trajectory.update();
-			if (showCOM)
-				centerOfMass.update(level.getPhysics());
+				player.move(level.getBodies(), level.getIntegration());
 				
-			flag.move();
+			flag.move(level.getIntegration().timeStep);
 
 			if (!gameOver && player.getLaunchState() == 4)
 			{
@@ -716,24 +754,11 @@ int main(int argc, char * argv[])
 			if (!gameOver)
 			{
 				playerPosition = player.getPosition();
-				if (playerPosition.x < 0 - spaceShipSize || playerPosition.x > SCR_WIDTH + spaceShipSize || playerPosition.y < 0 - spaceShipSize || playerPosition.y > SCR_HEIGHT + spaceShipSize)
+				// Game ticks rather than wall-clock time, so time warp neither speeds up nor delays the loss
+				if (loseSignal(playerPosition, level.getIntegration().timeStep, outOfBounds))
 				{
-					if (outOfBounds == 0.0f)
-					{
-						outOfBounds = glfwGetTime();
-					}
-					else
-					{
-						if ((currentTime - outOfBounds) * speedMultiplicator >= 5.0f)
-						{
-							gameOver = true;
-							signalLost = true;
-						}
-					}
-				}
-				else
-				{
-					outOfBounds = 0.0f;
+					gameOver = true;
+					signalLost = true;
 				}
 			}
 
@@ -763,6 +788,237 @@ int main(int argc, char * argv[])
 			}
 		}
 
+		tickCount += batchTicks;
+		if (batchTicks > 1)
+			caughtUpTicks += batchTicks - 1;
+
+		if (batchTicks > 0)
+		{
+			if (player.getLaunchState() == 0 && drawTrajectory)
+				trajectory.post(level, player, longTrajectory ? longTrajectoryTicks : trajectoryTicks, drawEnsemble);
+			if (showCOM)
+				centerOfMass.update(level.getBodies());
+			if (showGradient)
+				gravGradient.update(SCR_WIDTH, SCR_HEIGHT, xCount, yCount, level.getBodies());
+		}
+
+		// Lower the time warp while the physics exceeds its budget, recover slowly once there is room again
+		if (overBudget)
+			timeWarp = std::max(1.0f, 0.8f * timeWarp);
+		else if (timeWarp < speedMultiplicator && glfwGetTime() - currentTime < 0.5 * physicsBudget)
+			timeWarp = std::min(speedMultiplicator, 1.05f * timeWarp);
+
+		// Launch solver, searches a slice of every loop while the ship waits on the pad and snaps it to a hit
+		if (autoAim && player.getLaunchState() == 0 && solver.update(level, player, autoAimBudget) == AutoAim::FOUND
+			&& (player.getLaunchAngle() != solver.getAngle() || player.getLaunchSpeed() != solver.getSpeed()))
+		{
+			player.aim(solver.getAngle(), solver.getSpeed());
+			changed = true;
+		}
+
+		// Publish the new state, the render thread always picks up the newest one
+		if (changed || batchTicks > 0)
+		{
+			// The level is only copied as a whole when another one was loaded, otherwise its state goes into the buffers of the copy
+			Snapshot& snapshot = snapshots.getBack();
+			if (snapshot.levelCount != levelCount || !snapshot.level.copyState(level))
+				snapshot.level = Level(level);
+			snapshot.player = player;
+			snapshot.flag = flag;
+			snapshot.centerOfMass = centerOfMass;
+			if (showGradient && snapshot.gravGradient.getVersion() != gravGradient.getVersion())
+				snapshot.gravGradient = gravGradient;
+			snapshot.trajectoryGeneration = trajectory.getGeneration();
+			snapshot.levelCount = levelCount;
+
+			snapshot.drawTrajectory = drawTrajectory;
+			snapshot.drawEnsemble = drawEnsemble;
+			snapshot.aimState = player.getLaunchState() == 0 ? solver.getState() : AutoAim::IDLE;
+			snapshot.showCOM = showCOM;
+			snapshot.showGradient = showGradient;
+			snapshot.pause = pause;
+			snapshot.gameOver = gameOver;
+			snapshot.gameWon = gameWon;
+			snapshot.signalLost = signalLost;
+			snapshot.outOfBounds = outOfBounds != 0.0f;
+			snapshot.counter = (int)(6.0 - outOfBounds / ticksPerSecond);
+			snapshot.planetID = planetID;
+			snapshot.moonID = moonID;
+			snapshot.blackHoleID = blackHoleID;
+			snapshot.speedMultiplicator = speedMultiplicator;
+			snapshot.timeWarp = timeWarp;
+			snapshot.speedCountdown = speedCountdown;
+			snapshot.currentTicks = currentTicks;
+
+			snapshot.time = currentTime;
+			snapshot.accumulator = accumulator;
+			snapshot.stepDuration = stepDuration;
+			snapshots.publish();
+		}
+
+		// Sleep until the next step is due, at most a few milliseconds to stay responsive to input
+		const double wait = std::min(0.004, (stepDuration - accumulator) / timeWarp);
+		if (wait > 0.0)
+			std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	// Load level list
+	// ---------------
+	if (argc == 1)
+		levelList = loadLevelList();
+	else
+		levelList = loadLevelList(argv[1]);
+
+	std::cout << "Loaded levels: " << levelList.size() << std::endl;
+	for (auto name  : levelList)
+	{
+		std::cout << name << std::endl;
+	}
+
+	if (levelList.size() == 0)
+	{
+		std::cout << "Directory 'level' must contain at least 1 valid level with file extension '.lvl'\n";
+		std::cout << "Press Enter to exit";
+		std::cin >> argv[0];
+		return 0;
+	}
+
+	std::cout << "Gravity kernel: " << Gravity::getName() << std::endl;
+
+	Level level = loadLevelByName(levelList[levelID]);
+	std::cout << "Loading level: " << level.getName() << std::endl;
+	level.genPhysics();
+	SpaceShip player(level.getPlanets()[0]);
+	TrajectoryWorker trajectory(player, trajectoryTicks, trajectoryStepBudget);
+	trajectory.setLevel(level);
+	trajectory.post(level, player, trajectoryTicks);
+	CenterOfMass centerOfMass;
+	GravGradient gravGradient;
+	gravGradient.setStaleness(gradientStaleness);
+	gravGradient.update(SCR_WIDTH, SCR_HEIGHT, xCount, yCount, level.getBodies());
+	Flag flag(level.getPlanets()[1]);
+
+	// GLFW: Setup
+	// -----------
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_SAMPLES, 4);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	//  Window creation
+	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "AstroFlight", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwGetWindowPos(window, &windowX, &windowY);
+
+	// Setting callback functions
+	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	glfwSetWindowPosCallback(window, windowPosCallback);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
+
+
+	// GLAD: loading OpenGL function pointers
+	// --------------------------------------
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	// Enabling z-buffer and blending
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glLineWidth(2);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_MULTISAMPLE);
+
+
+	// Building necessary shader programs
+	// ----------------------------------
+	Shader shaderSimple = addShader("vDefault", "fSimple");			// Black holes, space ship, trajectory
+	Shader shaderLighting = addShader("vDefault", "fLighting");		// Planets, moons
+	Shader shaderField = addShader("vDefault", "fGravField");		// Gravitational fields
+	Shader shaderAtmosphere = addShader("vDefault", "fAtmosphere");	// Atmosphere of planets and moons
+	Shader shaderGradient = addShader("vDefault", "fGradient");		// Stars, center of mass and event horizon of black holes
+	Shader shaderGravGradient = addShader("vOutColor", "fInColor");	// Gravity gradient
+	Shader shaderText = addShader("vText", "fText");				// GUI text
+	Shader shaderBox = addShader("vGUI", "fAlpha");					// GUI text box
+	Shader shaderBand = addShader("vDefault", "fAlpha");			// Uncertainty band of the trajectory
+
+	// Lighting setup
+	shaderLighting.use();
+	shaderLighting.setVec3("light.color", glm::vec3(255, 255, 255));
+	shaderLighting.setVec3("light.direction", glm::vec3(1.0f, -1.0f, 0.0f));
+
+	// Loading GUI
+	GUI::textInit();
+	std::string guiGameSpeed, guiLaunchSpeed, guiLaunchAngle, guiHitChance, guiAutoAim, guiLevelName, guiScore, guiGameOver, guiMass, guiFPS;
+	GLuint infoBoxAddonsX = level.getName().length();
+	GLuint infoBoxAddonsY = 1;
+	GLuint counterOffset = 0;
+	glm::vec3 guiTextColor = glm::vec3(0.5f, 0.8f, 0.2f);
+	glm::vec4 guiBoxColor = glm::vec4(0.0f, 0.0f, 0.0f, 0.3f);
+
+	// Simulation thread, from here on only it touches the level and the game objects above
+	// ------------------------------------------------------------------------------------
+	TripleBuffer<Snapshot> snapshots(Snapshot(level, player, flag));
+	std::atomic<bool> running(true);
+	std::thread simulation(simulate, std::ref(level), std::ref(player), std::ref(trajectory), std::ref(flag), std::ref(centerOfMass), std::ref(gravGradient), std::ref(snapshots), std::cref(running));
+
+	std::vector<Star> stars = generateStars();
+	unsigned int starsLevel = 0;
+	double currentTime = glfwGetTime();
+	double lastSecond = currentTime;
+
+	// Render loop
+	// -----------
+	while (!glfwWindowShouldClose(window))
+	{	
+		currentTime = glfwGetTime();
+
+		// Executes once per second
+		if (currentTime - lastSecond >= 1.0f)
+		{
+			lastSecond = currentTime;
+			currentFPS = frameCount;
+			frameCount = 0;
+		}
+		else
+			++frameCount;
+
+		// Newest state published by the simulation
+		Snapshot& snapshot = snapshots.read();
+		Level& level = snapshot.level;
+		SpaceShip& player = snapshot.player;
+		Flag& flag = snapshot.flag;
+
+		if (snapshot.levelCount != starsLevel)
+		{
+			stars = generateStars();
+			starsLevel = snapshot.levelCount;
+		}
+
+		// Progress between the last and the next physics step, objects are drawn blended by it
+		// The snapshot may be a little old, the game time passed since it was published is added
+		const GLfloat alpha = (GLfloat)std::min(1.0, (snapshot.accumulator + (currentTime - snapshot.time) * snapshot.timeWarp) / snapshot.stepDuration);
+
 		// Clear buffers
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -773,53 +1029,51 @@ int main(int argc, char * argv[])
 		drawStars(stars, shaderGradient);
 
 		// Draw gravity field (z = -0.5f)
-		if (planetID != -1)
-			level.getPlanets()[planetID].drawField(shaderField);
-		if (moonID != -1)
-			level.getMoons()[moonID].drawField(shaderField);
-		if (blackHoleID != -1)
-			level.getBlackHoles()[blackHoleID].drawField(shaderField);
+		if (snapshot.planetID != -1)
+			level.getPlanets()[snapshot.planetID].drawField(shaderField, alpha);
+		if (snapshot.moonID != -1)
+			level.getMoons()[snapshot.moonID].drawField(shaderField, alpha);
+		if (snapshot.blackHoleID != -1)
+			level.getBlackHoles()[snapshot.blackHoleID].drawField(shaderField, alpha);
 
 		// Draw trajectory (z = -0.25f)
-		if (drawTrajectory)
-			trajectory.draw(shaderSimple);
+		// The worker may still be busy with the previous level, its samples are skipped then
+		const TrajectoryWorker::Result& path = trajectory.read();
+		const bool showPath = snapshot.drawTrajectory && path.generation == snapshot.trajectoryGeneration;
+		const bool showBand = showPath && snapshot.drawEnsemble && !path.band.empty();
+		if (showBand)
+			Ensemble::drawBand(shaderBand, path.band);
+		if (showPath)
+			Trajectory::drawSamples(shaderSimple, path.samples);
 
 		// Draw objects (z = 0.0f)
-		player.draw(shaderSimple);
-		flag.draw(shaderSimple);
+		player.draw(shaderSimple, alpha);
+		flag.draw(shaderSimple, alpha);
 
 		for (auto pm : level.getPointMasses())
-			pm.drawField(shaderField);
+			pm.drawField(shaderField, alpha);
 		for (auto planet : level.getPlanets())
-			planet.draw(shaderLighting);
+			planet.draw(shaderLighting, alpha);
 		for (auto & moon : level.getMoons())
-			moon.draw(shaderLighting);
+			moon.draw(shaderLighting, alpha);
 		for (auto & bh : level.getBlackHoles())		// z = 0.4f (event horizon) and 0.6f (hole)
-			bh.draw(shaderSimple, shaderGradient);
+			bh.draw(shaderSimple, shaderGradient, alpha);
 		for (auto & box : level.getBoxes())
-			box.draw(shaderSimple);
+			box.draw(shaderSimple, alpha);
 
 		// Draw atmospheres (z = 0.5f)
 		for (auto planet : level.getPlanets())
-			planet.drawAtmosphere(shaderAtmosphere);
+			planet.drawAtmosphere(shaderAtmosphere, alpha);
 		for (auto & moon : level.getMoons())
-			moon.drawAtmosphere(shaderAtmosphere);
+			moon.drawAtmosphere(shaderAtmosphere, alpha);
 
 		// Draw center of mass
-		if (showCOM)
-			centerOfMass.draw(shaderGradient);
+		if (snapshot.showCOM)
+			snapshot.centerOfMass.draw(shaderGradient);
 
 		// Draw gravity gradient
-		if (showGradient)
-		{
-			// Uncomment for better performance
-			//if (!createdGradient)
-			//{
-				gravGradient.update(SCR_WIDTH, SCR_HEIGHT, xCount, yCount, level.getPhysics());
-			//	createdGradient = true;
-			//}
-			gravGradient.draw(shaderGravGradient);
-		}
+		if (snapshot.showGradient)
+			snapshot.gravGradient.draw(shaderGravGradient);
 			
 
 		// Draw GUI
@@ -830,11 +1084,12 @@ int main(int argc, char * argv[])
 				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
 			// Launch settings box
-			GUI::renderBox(shaderBox, 5, 3, 258, 60, guiBoxColor);
+			const bool showAim = snapshot.aimState != AutoAim::IDLE;
+			GUI::renderBox(shaderBox, 5, 3, 258, 60+(showBand+showAim)*30, guiBoxColor);
 
 			// Info box
 			infoBoxAddonsX = level.getName().length();
-			infoBoxAddonsY = showFPS + (pause || speedCountdown > 0);
+			infoBoxAddonsY = showFPS + (snapshot.pause || snapshot.speedCountdown > 0 || snapshot.timeWarp < snapshot.speedMultiplicator);
 			GUI::renderBox(shaderBox, 5, SCR_HEIGHT-67-infoBoxAddonsY*30, 142+infoBoxAddonsX*9, 60+infoBoxAddonsY*30, guiBoxColor);
 
 			// Launch angle
@@ -850,6 +1105,25 @@ int main(int argc, char * argv[])
 			guiLaunchSpeed = std::string("Launch speed:  ").append(guiLaunchSpeed.substr(0, guiLaunchSpeed.length()-5));
 			GUI::renderText(shaderText, guiLaunchSpeed, 10, 40, 0.5f, guiTextColor);
 
+			// Share of the ensemble landing on the target
+			if (showBand)
+			{
+				guiHitChance = std::string("Hit chance:    ").append(std::to_string((int)round(100.0f * path.hitChance))).append("%");
+				GUI::renderText(shaderText, guiHitChance, 10, 70, 0.5f, guiTextColor);
+			}
+
+			// Launch solver progress
+			if (showAim)
+			{
+				if (snapshot.aimState == AutoAim::SEARCHING)
+					guiAutoAim = std::string("Auto-aim:      searching");
+				else if (snapshot.aimState == AutoAim::FOUND)
+					guiAutoAim = std::string("Auto-aim:      on target");
+				else
+					guiAutoAim = std::string("Auto-aim:      no solution");
+				GUI::renderText(shaderText, guiAutoAim, 10, 70+showBand*30, 0.5f, guiTextColor);
+			}
+
 			// Level name
 			guiLevelName = std::string("Level: ").append(level.getName());
 			GUI::renderText(shaderText, guiLevelName, 10, SCR_HEIGHT-30, 0.5f, guiTextColor);
@@ -861,14 +1135,18 @@ int main(int argc, char * argv[])
 			// Framerate
 			if (showFPS)
 			{
-				guiFPS = std::string("FPS: ").append(std::to_string(currentFPS));
+				guiFPS = std::string("FPS: ").append(std::to_string(currentFPS)).append("  Ticks: ").append(std::to_string(snapshot.currentTicks));
 				GUI::renderText(shaderText, guiFPS, 10, SCR_HEIGHT-90, 0.5f, guiTextColor);
 			}
 
 			// Game speed multiplier and pause notification
-			if (speedCountdown)
-				guiGameSpeed = std::string("Speed: ").append(std::to_string(speedMultiplicator).substr(0,4).append("x"));
-			else if (pause)
+			if (snapshot.speedCountdown || snapshot.timeWarp < snapshot.speedMultiplicator)
+			{
+				guiGameSpeed = std::string("Speed: ").append(formatSpeed(snapshot.speedMultiplicator));
+				if (snapshot.timeWarp < snapshot.speedMultiplicator)
+					guiGameSpeed.append(" (").append(formatSpeed(snapshot.timeWarp)).append(")");
+			}
+			else if (snapshot.pause)
 				guiGameSpeed = std::string("Paused");
 			else
 				guiGameSpeed = std::string("");
@@ -876,14 +1154,14 @@ int main(int argc, char * argv[])
 
 
 			// Game won/lost message and out-of-bounds-counter
-			if (gameOver)
+			if (snapshot.gameOver)
 			{
-				if (gameWon)
+				if (snapshot.gameWon)
 				{
 					//GUI::renderBox(shaderBox, 520, 335, 242, 50, guiBoxColor);
 					GUI::renderText(shaderText, "You won", 528, 345, 1.0f, guiTextColor);
 				}
-				else if (signalLost)
+				else if (snapshot.signalLost)
 				{
 					//GUI::renderBox(shaderBox, 490, 335, 304, 50, guiBoxColor);
 					GUI::renderText(shaderText, "Signal lost", 496, 345, 1.0f, guiTextColor);
@@ -894,9 +1172,9 @@ int main(int argc, char * argv[])
 					GUI::renderText(shaderText, "You lost", 533, 345, 1.0f, guiTextColor);
 				}
 			}
-			else if (outOfBounds != 0.0f)
+			else if (snapshot.outOfBounds)
 			{
-				counter = (int)(6.0f - (currentTime - outOfBounds) * speedMultiplicator);
+				int counter = snapshot.counter;
 				//GUI::renderBox(shaderBox, 618, 335, 49, 50, guiBoxColor);
 
 				switch (counter)
@@ -932,6 +1210,9 @@ int main(int argc, char * argv[])
 		glfwPollEvents();
 	}
 	
+	running = false;
+	simulation.join();
+
 	// glfw: terminate, clearing all previously allocated GLFW resources
 	// -----------------------------------------------------------------
 	glfwTerminate();
@@ -0,0 +1,200 @@
+// C interface of the batch environment, see astroflight_env.h
+// Compile: g++ -std=c++1z astroflight_env.cpp -o libastroflight_env.so -O3 -shared -fPIC -fvisibility=hidden -lstdc++fs -lpthread
+// ---------------------------------------------------------------------------------------------------------------------------
+
+#ifndef HEADLESS
+#define HEADLESS		// Game objects without their draw code, see opengl.hpp
+#endif
+
+#include "astroflight_env.h"
+#include "batch_env.hpp"
+
+#include <string>
+#include <exception>
+#include <iostream>
+
+struct AfEnv
+{
+	BatchEnv env;
+
+	AfEnv(const std::string levelPath, const unsigned int episodes, const float maxTicks)
+		: env(levelPath, episodes, maxTicks)
+	{}
+};
+
+
+unsigned int af_env_abi_version(void)
+{
+	return AF_ENV_ABI_VERSION;
+}
+
+// No C++ exception may unwind into the caller, every entry point below catches them and returns NULL or 0
+// --------------------------------------------------------------------------------------------------------
+AfEnv * af_env_create(const char * level_path, unsigned int episodes, float max_ticks)
+{
+	if (!level_path || episodes == 0)
+		return nullptr;
+
+	try
+	{
+		AfEnv * env = new AfEnv(level_path, episodes, max_ticks);
+		if (!env->env.isValid())
+		{
+			delete env;
+			return nullptr;
+		}
+		return env;
+	}
+	catch (const std::exception& exception)
+	{
+		std::cout << "Error: Could not create the environment for " << level_path << ": " << exception.what() << std::endl;
+	}
+	catch (...)
+	{
+		std::cout << "Error: Could not create the environment for " << level_path << std::endl;
+	}
+	return nullptr;
+}
+
+void af_env_destroy(AfEnv * env)
+{
+	delete env;
+}
+
+void af_env_reset(AfEnv * env)
+{
+	if (!env)
+		return;
+	try
+	{
+		env->env.reset();
+	}
+	catch (...) {}
+}
+
+unsigned int af_env_reset_done(AfEnv * env)
+{
+	if (!env)
+		return 0;
+	try
+	{
+		return env->env.resetDone();
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+void af_env_aim(AfEnv * env, const float * angles, const float * speeds)
+{
+	if (!env)
+		return;
+	try
+	{
+		env->env.aim(angles, speeds);
+	}
+	catch (...) {}
+}
+
+void af_env_step(AfEnv * env, const unsigned char * actions)
+{
+	if (!env || !env->env.isValid())
+		return;
+	try
+	{
+		env->env.step(actions);
+	}
+	catch (...) {}
+}
+
+unsigned int af_env_episodes(const AfEnv * env)
+{
+	return env ? env->env.size() : 0;
+}
+
+unsigned int af_env_running(const AfEnv * env)
+{
+	return env ? env->env.getRunning() : 0;
+}
+
+unsigned int af_env_bodies(const AfEnv * env)
+{
+	return env ? env->env.getBodies().size() : 0;
+}
+
+float af_env_time_step(const AfEnv * env)
+{
+	return env ? env->env.getTimeStep() : 0.0f;
+}
+
+const float * af_env_column(const AfEnv * env, int column)
+{
+	if (!env)
+		return nullptr;
+
+	const BatchEnv& batch = env->env;
+	switch (column)
+	{
+	case AF_X:
+		return batch.getProbes().x.data();
+	case AF_Y:
+		return batch.getProbes().y.data();
+	case AF_VX:
+		return batch.getProbes().vx.data();
+	case AF_VY:
+		return batch.getProbes().vy.data();
+	case AF_ANGLE:
+		return batch.getAngle().data();
+	case AF_LAUNCH_SPEED:
+		return batch.getLaunchSpeed().data();
+	case AF_TICKS:
+		return batch.getTicks().data();
+	case AF_REWARD:
+		return batch.getReward().data();
+	case AF_SCORE:
+		return batch.getScore().data();
+	default:
+		return nullptr;
+	}
+}
+
+const unsigned char * af_env_byte_column(const AfEnv * env, int column)
+{
+	if (!env)
+		return nullptr;
+
+	const BatchEnv& batch = env->env;
+	switch (column)
+	{
+	case AF_STATUS:
+		return batch.getStatus().data();
+	case AF_LAUNCH_STATE:
+		return batch.getLaunchState().data();
+	case AF_BOXES:
+		return batch.getBoxes().data();
+	default:
+		return nullptr;
+	}
+}
+
+const float * af_env_body_column(const AfEnv * env, int column)
+{
+	if (!env)
+		return nullptr;
+
+	const Bodies& bodies = env->env.getBodies();
+	switch (column)
+	{
+	case AF_BODY_X:
+		return bodies.x.data();
+	case AF_BODY_Y:
+		return bodies.y.data();
+	case AF_BODY_RADIUS:
+		return bodies.radius.data();
+	case AF_BODY_MASS:
+		return bodies.mass.data();
+	default:
+		return nullptr;
+	}
+}
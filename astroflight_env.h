@@ -0,0 +1,111 @@
+#ifndef ASTROFLIGHT_ENV_H
+#define ASTROFLIGHT_ENV_H
+
+/* C interface of the batch environment (see batch_env.hpp), built as libastroflight_env
+ * Many independent episodes of one level are stepped in lockstep, each with its own ship, boxes and score.
+ * Observations are read straight from the episode table: the column pointers stay valid until the
+ * environment is destroyed, also across af_env_reset, and are rewritten by every call that changes the episodes.
+ * No C++ exception crosses this interface: failed calls and calls with a NULL env return NULL or 0, or do nothing.
+ * The layout of this header only ever grows, AF_ENV_ABI_VERSION counts incompatible changes.
+ * --------------------------------------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+#define AF_ENV_API __declspec(dllexport)
+#else
+#define AF_ENV_API __attribute__((visibility("default")))
+#endif
+
+#define AF_ENV_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AfEnv AfEnv;
+
+/* Actions, one combination per episode and step, as the keys of the game */
+enum
+{
+	AF_ROTATE_LEFT = 1,		/* Turns the ship on the pad */
+	AF_ROTATE_RIGHT = 2,
+	AF_SPEED_UP = 4,		/* Adjusts the launch speed on the pad */
+	AF_SPEED_DOWN = 8,
+	AF_LAUNCH = 16,
+	AF_BOOST = 32,			/* Once, after the launch */
+	AF_DROP_BOX = 64,		/* Up to 3 boxes while flying */
+	AF_PRECISION = 128		/* Rotation and speed changes in small steps */
+};
+
+/* Status of an episode */
+enum
+{
+	AF_RUNNING = 0,
+	AF_WON = 1,
+	AF_CRASHED = 2,
+	AF_LOST = 3,			/* Signal lost outside the window */
+	AF_TIMEOUT = 4
+};
+
+/* Float columns, one value per episode */
+enum
+{
+	AF_X = 0,				/* Ship position */
+	AF_Y = 1,
+	AF_VX = 2,				/* Ship velocity */
+	AF_VY = 3,
+	AF_ANGLE = 4,			/* Heading in radians, the launch angle while on the pad */
+	AF_LAUNCH_SPEED = 5,
+	AF_TICKS = 6,			/* Game ticks since the episode started */
+	AF_REWARD = 7,			/* Score gained in the last step */
+	AF_SCORE = 8
+};
+
+/* Byte columns, one value per episode */
+enum
+{
+	AF_STATUS = 0,
+	AF_LAUNCH_STATE = 1,	/* 0 not launched, 1 launching, 2 launched, 3 boosted, 4 landed */
+	AF_BOXES = 2			/* Boxes dropped */
+};
+
+/* Body columns, one value per body of the level */
+enum
+{
+	AF_BODY_X = 0,
+	AF_BODY_Y = 1,
+	AF_BODY_RADIUS = 2,
+	AF_BODY_MASS = 3
+};
+
+AF_ENV_API unsigned int af_env_abi_version(void);
+
+/* Loads a level file for the given number of episodes, NULL if the level is invalid or episodes is 0
+ * Episodes time out max_ticks game ticks after they started */
+AF_ENV_API AfEnv * af_env_create(const char * level_path, unsigned int episodes, float max_ticks);
+AF_ENV_API void af_env_destroy(AfEnv * env);
+
+/* Restarts the level and puts every episode on the pad */
+AF_ENV_API void af_env_reset(AfEnv * env);
+/* Puts the episodes that ended back on the pad, the bodies carry on, returns their number */
+AF_ENV_API unsigned int af_env_reset_done(AfEnv * env);
+/* Sets launch angles (radians) and speeds of the episodes still on the pad, either may be NULL */
+AF_ENV_API void af_env_aim(AfEnv * env, const float * angles, const float * speeds);
+/* Advances every running episode by one physics step, actions may be NULL */
+AF_ENV_API void af_env_step(AfEnv * env, const unsigned char * actions);
+
+AF_ENV_API unsigned int af_env_episodes(const AfEnv * env);
+AF_ENV_API unsigned int af_env_running(const AfEnv * env);
+AF_ENV_API unsigned int af_env_bodies(const AfEnv * env);
+/* Game ticks per physics step of the level */
+AF_ENV_API float af_env_time_step(const AfEnv * env);
+
+/* Column pointers, NULL for unknown columns */
+AF_ENV_API const float * af_env_column(const AfEnv * env, int column);
+AF_ENV_API const unsigned char * af_env_byte_column(const AfEnv * env, int column);
+AF_ENV_API const float * af_env_body_column(const AfEnv * env, int column);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef AUTO_AIM_H
+#define AUTO_AIM_H
+
+#include "opengl.hpp"
+
+#include "glm/glm.hpp"			// Vectors
+#include "physics.hpp"			// Body store, gravity and collisions
+#include "integrator.hpp"
+#include "ephemeris.hpp"
+#include "game_objects.hpp"		// SpaceShip
+#include "level.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+// Launch solver, a shooting method on the closest approach to the target planet
+// Each shot flies a launch like the game would, against the same future bodies as the Trajectory, and
+// measures how close the ship's collision circle gets to the target's surface (<= 0 is a landing).
+// A coarse scan over angle and speed starting at the player's settings picks a few seeds, from which
+// Gauss-Newton steps on finite differences drive the miss below zero, aiming a little inside the planet
+// so the landing doesn't hinge on grazing it. The search is resumable and stops at a deadline, so it
+// can spend a fixed slice of every frame. Once it ends, it starts over as soon as the bodies move or the
+// player changes the settings, warm-started from them, which keeps it on target while a level is edited.
+// --------------------------------------------------------------------------------------------------------
+class AutoAim
+{
+public:
+	enum State { IDLE, SEARCHING, FOUND, FAILED };
+
+private:
+	struct Shot
+	{
+		GLfloat angle = 0;
+		GLfloat speed = 0;
+		GLfloat miss = 0;				// Closest distance of the ship's collision circle to the target's surface
+	};
+
+	// Next shot after the scan: probes along both coordinates, then a trial step
+	enum Phase { SCAN, PROBE_ANGLE, PROBE_SPEED, TRIAL };
+
+	const unsigned int TTL;				// Game ticks flown per shot
+	State state = IDLE;
+	Phase phase = SCAN;
+
+	// Scan, the player's settings come first
+	std::vector<Shot> scan;
+	unsigned int scanned = 0;
+	std::vector<Shot> seeds;
+	unsigned int seed = 0;
+
+	// Refinement of the current seed, slopes are per unit of the scaled coordinates
+	Shot point;
+	GLfloat slopeAngle = 0;
+	GLfloat slopeSpeed = 0;
+	GLfloat trust = 1;					// Longest step in scaled coordinates
+	unsigned int shots = 0;				// Shots spent on the seed
+	GLfloat radius = 0;					// Of the target, sets the depth aimed at
+
+	// Shot in flight, continued by the next update() after a deadline
+	Shot shot;
+	bool flying = false;
+	glm::vec2 position, velocity, acceleration;
+	GLfloat stepSize = 0;
+	GLfloat time = 0;
+	GLfloat outside = 0;				// Game ticks spent outside the window
+	unsigned int launchVersion = 0;		// Level state the shot was launched in
+
+	// Inputs the result belongs to, a change starts a new search
+	Shot solution;
+	GLfloat keyAngle = 0;
+	GLfloat keySpeed = 0;
+	unsigned int keyVersion = 0;
+
+	static constexpr unsigned int scanAngles = 36;
+	static constexpr GLfloat speedSpacing = 1.0f;		// Between scanned speeds
+	static constexpr GLfloat angleScale = 2.0f * 3.14159265f / scanAngles;	// Coordinates are scaled to the scan grid
+	static constexpr GLfloat speedScale = speedSpacing;
+	static constexpr unsigned int maxSeeds = 4;
+	static constexpr GLfloat seedSpacing = 1.5f;		// Seeds lie at least this far apart in scaled coordinates
+	static constexpr GLfloat probeDistance = 0.05f;		// Finite difference step in scaled coordinates
+	static constexpr GLfloat maxTrust = 2.0f;
+	static constexpr GLfloat minTrust = 1.0f / 64.0f;
+	static constexpr unsigned int maxShots = 30;		// Per seed
+	static constexpr GLfloat aimDepth = 0.5f;			// Depth aimed at, relative to the target radius
+	static constexpr unsigned int clockInterval = 16;	// Steps between deadline checks
+
+	static GLfloat wrap(GLfloat angle)
+	{
+		angle = std::fmod(angle, twicePi);
+		if (angle < 0)
+			angle += twicePi;
+		return angle >= twicePi ? 0.0f : angle;
+	}
+
+	static Shot make(const GLfloat angle, const GLfloat speed)
+	{
+		Shot shot;
+		shot.angle = wrap(angle);
+		shot.speed = std::min(maxLaunchSpeed, std::max(minLaunchSpeed, speed));
+		return shot;
+	}
+
+	// Distance of two shots in scaled coordinates, the short way round in angle
+	static GLfloat distance(const Shot& a, const Shot& b)
+	{
+		const GLfloat angle = (GLfloat)std::remainder(a.angle - b.angle, twicePi) / angleScale;
+		const GLfloat speed = (a.speed - b.speed) / speedScale;
+		return std::sqrt(angle * angle + speed * speed);
+	}
+
+	// Starts a search from the player's settings
+	// -------------------------------------------
+	void begin(const SpaceShip& player, const unsigned int version)
+	{
+		scan.clear();
+		scan.push_back(make(player.getLaunchAngle(), player.getLaunchSpeed()));
+		for (GLfloat speed = minLaunchSpeed; speed <= maxLaunchSpeed; speed += speedSpacing)
+		{
+			for (unsigned int i = 0; i < scanAngles; ++i)
+				scan.push_back(make(i * angleScale, speed));
+		}
+		scanned = 0;
+		seeds.clear();
+		seed = 0;
+		phase = SCAN;
+		flying = false;
+
+		state = SEARCHING;
+		keyAngle = scan[0].angle;
+		keySpeed = scan[0].speed;
+		keyVersion = version;
+	}
+
+	void finish(const State result, const Shot& best)
+	{
+		state = result;
+		flying = false;
+		if (result == FOUND)
+		{
+			solution = best;
+			// Once snapped to, the solution is what the player has set
+			keyAngle = best.angle;
+			keySpeed = best.speed;
+		}
+	}
+
+	// Gravity and collisions during the tick starting at a game time, like the Trajectory
+	// Bodies moved on since the launch, the ephemeris is read that many steps earlier
+	// ------------------------------------------------------------------------------------
+	unsigned int stepAt(const Ephemeris& ephemeris, const Level& level, const GLfloat time) const
+	{
+		const GLfloat shift = (level.getStateVersion() - launchVersion) * level.getIntegration().timeStep;
+		return ephemeris.getStep(std::max(0.0f, time - shift));
+	}
+
+	void launch(Level& level, const SpaceShip& player, const Shot& next)
+	{
+		shot = next;
+		flying = true;
+
+		// The ship sits on its start planet, other launch angles move it around the planet
+		const GLfloat axis = player.getAxis();
+		const glm::vec2 center = player.getPosition() - axis * glm::vec2(std::cos(player.getAngle()), std::sin(player.getAngle()));
+		const glm::vec2 direction(std::cos(shot.angle), std::sin(shot.angle));
+		position = center + axis * direction;
+		velocity = shot.speed * direction;
+		acceleration = glm::vec2(0.0f, 0.0f);
+		stepSize = 0;
+		time = 0;
+		outside = 0;
+		launchVersion = level.getStateVersion();
+		shot.miss = std::numeric_limits<GLfloat>::max();
+	}
+
+	// Flies the shot in flight until it ends or the deadline passes, true if it ended
+	// Steps the way SpaceShip::move() does, the first step after the launch skips the collision test
+	// ------------------------------------------------------------------------------------------------
+	bool fly(Level& level, const std::chrono::steady_clock::time_point deadline)
+	{
+		const Bodies& bodies = level.getBodies();
+		const Ephemeris * ephemeris = level.getEphemeris();
+		const Integrator::Settings& integration = level.getIntegration();
+		const unsigned int target = level.getTargetBody();
+		const GLfloat targetRadius = bodies.radius[target] + collisionShip;
+
+		for (unsigned int i = 1; time < TTL; ++i)
+		{
+			if (i % clockInterval == 0 && std::chrono::steady_clock::now() >= deadline)
+				return false;
+
+			const unsigned int step = ephemeris ? stepAt(*ephemeris, level, time) : 0;
+			auto field = [&](const glm::vec2 p) { return ephemeris ? ephemeris->acceleration(step, p) : bodies.acceleration(p); };
+
+			if (Integrator::reusesAcceleration(integration))
+				acceleration = field(position);
+			Integrator::advance(integration, position, velocity, acceleration, stepSize, field);
+			const bool first = time == 0;
+			time += integration.timeStep;
+
+			const glm::vec2 center = ephemeris ? ephemeris->getPosition(step, target) : glm::vec2(bodies.x[target], bodies.y[target]);
+			shot.miss = std::min(shot.miss, glm::distance(position, center) - targetRadius);
+
+			if (!first && (ephemeris ? ephemeris->collision(step, position, collisionShip) : bodies.collision(position, collisionShip)) >= 0)
+				return true;
+
+			// Out of the window for too long, the game counts it as lost
+			if (loseSignal(position, integration.timeStep, outside))
+				return true;
+		}
+		return true;
+	}
+
+	// Seeds for the refinement, the closest scanned shots that lie apart from each other
+	// -----------------------------------------------------------------------------------
+	void pickSeeds()
+	{
+		std::sort(scan.begin(), scan.end(), [](const Shot& a, const Shot& b) { return a.miss < b.miss; });
+		for (const Shot& candidate : scan)
+		{
+			bool apart = true;
+			for (const Shot& other : seeds)
+				apart = apart && distance(candidate, other) >= seedSpacing;
+			if (apart)
+				seeds.push_back(candidate);
+			if (seeds.size() == maxSeeds)
+				break;
+		}
+	}
+
+	void nextSeed()
+	{
+		if (seed == seeds.size())
+		{
+			finish(FAILED, point);
+			return;
+		}
+		point = seeds[seed++];
+		trust = 1;
+		shots = 0;
+		phase = PROBE_ANGLE;
+	}
+
+	// Next shot of the search, valid while SEARCHING
+	// -----------------------------------------------
+	Shot next() const
+	{
+		switch (phase)
+		{
+		case SCAN:
+			return scan[scanned];
+		case PROBE_ANGLE:
+			return make(point.angle + probeDistance * angleScale, point.speed);
+		case PROBE_SPEED:
+			// Speeds are probed downwards at the upper limit
+			if (point.speed + probeDistance * speedScale > maxLaunchSpeed)
+				return make(point.angle, point.speed - probeDistance * speedScale);
+			return make(point.angle, point.speed + probeDistance * speedScale);
+		default:
+		{
+			// Gauss-Newton step towards a miss of -aimDepth radii, at most trust long
+			const GLfloat goal = point.miss + aimDepth * radius;
+			const GLfloat norm = slopeAngle * slopeAngle + slopeSpeed * slopeSpeed;
+			GLfloat angle = -goal * slopeAngle / norm;
+			GLfloat speed = -goal * slopeSpeed / norm;
+			const GLfloat length = std::sqrt(angle * angle + speed * speed);
+			if (length > trust)
+			{
+				angle *= trust / length;
+				speed *= trust / length;
+			}
+			return make(point.angle + angle * angleScale, point.speed + speed * speedScale);
+		}
+		}
+	}
+
+	// Takes in the result of a shot and moves the search on
+	// ------------------------------------------------------
+	void land(const Shot& result)
+	{
+		if (result.miss <= 0)
+		{
+			finish(FOUND, result);
+			return;
+		}
+
+		switch (phase)
+		{
+		case SCAN:
+			scan[scanned] = result;
+			if (++scanned == scan.size())
+			{
+				pickSeeds();
+				nextSeed();
+			}
+			return;
+		case PROBE_ANGLE:
+			slopeAngle = (result.miss - point.miss) / probeDistance;
+			phase = PROBE_SPEED;
+			break;
+		case PROBE_SPEED:
+			slopeSpeed = (result.miss - point.miss) / ((result.speed - point.speed) / speedScale);
+			phase = TRIAL;
+			// Flat around the seed, Newton has no direction to go
+			if (slopeAngle * slopeAngle + slopeSpeed * slopeSpeed < 1.0e-6f)
+			{
+				nextSeed();
+				return;
+			}
+			break;
+		case TRIAL:
+			if (result.miss < point.miss)
+			{
+				point = result;
+				trust = std::min(maxTrust, 2.0f * trust);
+				phase = PROBE_ANGLE;
+			}
+			else
+			{
+				trust *= 0.5f;
+				if (trust < minTrust)
+				{
+					nextSeed();
+					return;
+				}
+			}
+			break;
+		}
+
+		if (++shots == maxShots)
+			nextSeed();
+	}
+
+public:
+	// Constructor
+	// Arguments: game ticks flown per shot
+	// ------------------------------------
+	AutoAim(const unsigned int TTL)
+		: TTL(TTL)
+	{
+		scan.reserve(1 + scanAngles * (unsigned int)((maxLaunchSpeed - minLaunchSpeed) / speedSpacing + 1));
+		seeds.reserve(maxSeeds);
+	}
+
+	// Starts solving for the player's ship, also restarts after a level change
+	void start(const SpaceShip& player, const Level& level)
+	{
+		begin(player, level.getStateVersion());
+	}
+
+	void stop()
+	{
+		state = IDLE;
+		flying = false;
+	}
+
+	// Searches until the budget in seconds is used up, call once per frame while the ship is on the pad
+	// A FOUND solution has to be given to the ship with SpaceShip::aim(), the search starts over when
+	// the player's settings or the bodies change later on.
+	// --------------------------------------------------------------------------------------------------
+	State update(Level& level, const SpaceShip& player, const double budget)
+	{
+		if (state == IDLE || player.getLaunchState() > 0)
+			return state;
+
+		// A search runs on while the bodies move, but not once the player took over
+		const unsigned int version = level.getStateVersion();
+		const Shot settings = make(player.getLaunchAngle(), player.getLaunchSpeed());
+		const bool sameSettings = settings.angle == keyAngle && settings.speed == keySpeed;
+		if (state == SEARCHING ? !sameSettings : !sameSettings || version != keyVersion)
+			begin(player, version);
+		else if (state != SEARCHING)
+			return state;
+
+		radius = level.getBodies().radius[level.getTargetBody()];
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(budget));
+		while (state == SEARCHING && std::chrono::steady_clock::now() < deadline)
+		{
+			if (!flying)
+				launch(level, player, next());
+			if (!fly(level, deadline))
+				break;
+			flying = false;
+			land(shot);
+		}
+
+		// The result is checked again once the bodies moved on from where the search ended
+		if (state != SEARCHING)
+			keyVersion = version;
+		return state;
+	}
+
+	// Getter functions
+	State getState() const
+	{
+		return state;
+	}
+	// Launch angle in radians and launch speed of the last solution
+	GLfloat getAngle() const
+	{
+		return solution.angle;
+	}
+	GLfloat getSpeed() const
+	{
+		return solution.speed;
+	}
+};
+
+#endif
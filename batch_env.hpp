@@ -0,0 +1,557 @@
+#ifndef BATCH_ENV_H
+#define BATCH_ENV_H
+
+#include "opengl.hpp"		// OpenGL headers, only the types in headless builds
+
+#include "glm/glm.hpp"			// Vectors
+#include "physics.hpp"			// Body store, gravity and collisions
+#include "integrator.hpp"
+#include "thread_pool.hpp"		// Episodes are spread over the shared pool
+#include "game_objects.hpp"		// Ship and box constants
+#include "level.hpp"
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+// Structure-of-arrays store of the probes of a batch, ships and boxes alike
+// Only live probes move, kick() and drift() leave the others untouched so whole ranges can be stepped at once
+// ------------------------------------------------------------------------------------------------------------
+class Probes
+{
+public:
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<float> ax;
+	std::vector<float> ay;
+	std::vector<float> live;		// 1 if the probe moves, 0 if not
+	std::vector<float> stepSize;	// Proposed adaptive step, carried between ticks
+
+	void resize(const unsigned int n)
+	{
+		x.assign(n, 0.0f);
+		y.assign(n, 0.0f);
+		vx.assign(n, 0.0f);
+		vy.assign(n, 0.0f);
+		ax.assign(n, 0.0f);
+		ay.assign(n, 0.0f);
+		live.assign(n, 0.0f);
+		stepSize.assign(n, 0.0f);
+	}
+
+	// Integrator building blocks for the probes in [first, last), see integrator.hpp
+	// Written as selects rather than branches so the compiler turns them into vector blends
+	// ----------------------------------------------------------------------------------------
+	void kick(const unsigned int first, const unsigned int last, const float dt)
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			vx[i] = live[i] != 0.0f ? vx[i] + dt * ax[i] : vx[i];
+			vy[i] = live[i] != 0.0f ? vy[i] + dt * ay[i] : vy[i];
+		}
+	}
+	void drift(const unsigned int first, const unsigned int last, const float dt)
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			x[i] = live[i] != 0.0f ? x[i] + dt * vx[i] : x[i];
+			y[i] = live[i] != 0.0f ? y[i] + dt * vy[i] : y[i];
+		}
+	}
+
+	// Gravity of the bodies at the probes in [first, last), written into ax and ay
+	void accelerate(const Bodies& bodies, const unsigned int first, const unsigned int last)
+	{
+		bodies.acceleration(&x[first], &y[first], &ax[first], &ay[first], last - first);
+	}
+
+	bool anyLive(const unsigned int first, const unsigned int last) const
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			if (live[i] != 0.0f)
+				return true;
+		}
+		return false;
+	}
+
+	glm::vec2 getPosition(const unsigned int i) const
+	{
+		return glm::vec2(x[i], y[i]);
+	}
+};
+
+
+// Many independent episodes of one level, stepped in lockstep
+// Every episode has its own ship, boxes and score, the bodies are shared: the level is stepped once per
+// step() and all episodes read the same (read-only) body store, precomputed by the level's ephemeris on
+// moving levels. Episodes keep the rules of the game: launch, boost and box drops as with the keys, landing
+// on the goal, crashes, the signal lost after 5 s outside the window, box scores on first terraforming.
+// An episode ends with its ship, boxes still in flight are dropped, and waits for resetDone(). Episodes
+// restarted that way start from the current state of the bodies, reset() restarts the level for all.
+// Each episode is one lane of a table (see Probes), the gravity of all lanes is summed with the field
+// kernels (see gravity.hpp) and chunks of lanes are spread over the thread pool.
+// -----------------------------------------------------------------------------------------------------------
+class BatchEnv
+{
+public:
+	enum Action
+	{
+		ROTATE_LEFT = 1,		// Turns the ship on the pad
+		ROTATE_RIGHT = 2,
+		SPEED_UP = 4,			// Adjusts the launch speed on the pad
+		SPEED_DOWN = 8,
+		LAUNCH = 16,
+		BOOST = 32,				// Once, after the launch
+		DROP_BOX = 64,			// Up to boxesPerEpisode while flying
+		PRECISION = 128			// Rotation and speed changes in small steps
+	};
+
+	enum Status { RUNNING, WON, CRASHED, LOST, TIMEOUT };
+
+	static constexpr unsigned int boxesPerEpisode = 3;	// As maxBoxes in astroflight.cpp
+
+private:
+	const std::string filePath;
+	const unsigned int count;
+	const float maxTicks;				// Game ticks until an episode times out
+	std::unique_ptr<Level> level;
+	Integrator::Settings integration;
+
+	// Lanes [0, count) are the ships, lane count * (1 + b) + e is box b of episode e
+	Probes probes;
+
+	// Episode table, one entry per episode
+	std::vector<float> angle;
+	std::vector<float> launchAngle;
+	std::vector<float> launchSpeed;
+	std::vector<float> ticks;			// Game ticks since the episode started
+	std::vector<float> outside;			// Game ticks spent outside the window
+	std::vector<float> reward;			// Score gained in the last step
+	std::vector<float> score;
+	std::vector<unsigned char> launchState;	// As SpaceShip: 0 not launched, 1 launching, 2 launched, 3 boosted, 4 landed
+	std::vector<unsigned char> status;
+	std::vector<unsigned char> boxes;	// Boxes dropped
+	std::vector<unsigned int> terraformed;	// Step each scoring body was terraformed in, slot s of episode e at e * slots + s
+
+	// Level layout
+	unsigned int start = 0;				// Body store index of the start and goal planet
+	unsigned int goal = 0;
+	unsigned int slots = 0;				// Bodies that score when terraformed
+	std::vector<int> bodySlot;			// Slot of each body, -1 if it doesn't score
+	std::vector<float> bodyScore;
+
+	static constexpr float defaultAngle = 90.0f;		// Degrees, as SpaceShip
+	static constexpr float defaultSpeed = 2.0f;
+	static constexpr unsigned int grain = 256;			// Episodes per task
+
+	unsigned int boxLane(const unsigned int episode, const unsigned int box) const
+	{
+		return count * (1 + box) + episode;
+	}
+
+	// Puts an episode on the pad of the start planet with the given launch settings
+	// -------------------------------------------------------------------------------
+	void place(const unsigned int e, const float newAngle, const float newSpeed)
+	{
+		angle[e] = launchAngle[e] = newAngle;
+		launchSpeed[e] = newSpeed;
+		ticks[e] = 0;
+		outside[e] = 0;
+		reward[e] = 0;
+		score[e] = 0;
+		launchState[e] = 0;
+		status[e] = RUNNING;
+		boxes[e] = 0;
+		std::fill(terraformed.begin() + e * slots, terraformed.begin() + (e + 1) * slots, 0u);
+		for (unsigned int b = 0; b < boxesPerEpisode; ++b)
+			probes.live[boxLane(e, b)] = 0.0f;
+		probes.live[e] = 0.0f;
+		probes.stepSize[e] = 0.0f;
+		onPad(e);
+	}
+
+	// The ship follows its start planet until the launch, as SpaceShip::move()
+	void onPad(const unsigned int e)
+	{
+		const Bodies& bodies = level->getBodies();
+		const float axis = bodies.radius[start] + spaceShipSize;
+		angle[e] = launchAngle[e];
+		probes.x[e] = bodies.x[start] + std::cos(angle[e]) * axis;
+		probes.y[e] = bodies.y[start] + std::sin(angle[e]) * axis;
+		probes.vx[e] = 0.0f;
+		probes.vy[e] = 0.0f;
+		probes.stepSize[e] = 0.0f;
+	}
+
+	// Applies the actions of the episodes in [first, last), in the order the game handles its keys
+	// ---------------------------------------------------------------------------------------------
+	void input(const unsigned int first, const unsigned int last, const unsigned char * actions)
+	{
+		for (unsigned int e = first; e < last; ++e)
+		{
+			reward[e] = 0;
+			if (status[e] != RUNNING || !actions)
+				continue;
+
+			const unsigned char action = actions[e];
+			const bool precision = (action & PRECISION) != 0;
+
+			if ((action & LAUNCH) && launchState[e] == 0)
+				launchState[e] = 1;
+
+			if ((action & BOOST) && launchState[e] == 2)
+			{
+				probes.vx[e] += boostPower * std::cos(angle[e]);
+				probes.vy[e] += boostPower * std::sin(angle[e]);
+				launchState[e] = 3;
+			}
+
+			if ((action & DROP_BOX) && launchState[e] >= 1 && launchState[e] <= 3 && boxes[e] < boxesPerEpisode)
+			{
+				const unsigned int b = boxLane(e, boxes[e]++);
+				probes.x[b] = probes.x[e];
+				probes.y[b] = probes.y[e];
+				probes.vx[b] = 0.0f;
+				probes.vy[b] = 0.0f;
+				probes.ax[b] = 0.0f;
+				probes.ay[b] = 0.0f;
+				probes.stepSize[b] = 0.0f;
+				probes.live[b] = 1.0f;
+			}
+
+			if (launchState[e] != 0)
+				continue;
+
+			const float speedStep = precision ? 0.05f : 0.5f;
+			if (action & SPEED_UP)
+				launchSpeed[e] += speedStep;
+			if (action & SPEED_DOWN)
+				launchSpeed[e] -= speedStep;
+			launchSpeed[e] = std::min(maxLaunchSpeed, std::max(minLaunchSpeed, launchSpeed[e]));
+
+			const float turn = rotationSpeed * (precision ? 0.1f : 1.0f) * integration.timeStep;
+			if (action & ROTATE_LEFT)
+				launchAngle[e] += turn;
+			if (action & ROTATE_RIGHT)
+				launchAngle[e] -= turn;
+			if (launchAngle[e] < 0)
+				launchAngle[e] += twicePi;
+			else if (launchAngle[e] >= twicePi)
+				launchAngle[e] -= twicePi;
+			angle[e] = launchAngle[e];
+		}
+	}
+
+	// Moves the live probes in [first, last) by one physics step through the current bodies
+	// ---------------------------------------------------------------------------------------
+	void advance(const unsigned int first, const unsigned int last)
+	{
+		if (!probes.anyLive(first, last))
+			return;
+
+		const Bodies& bodies = level->getBodies();
+		if (integration.tolerance > 0.0f)
+		{
+			// Adaptive steps differ between probes, they can't share a lockstep
+			auto field = [&bodies](const glm::vec2 p) { return bodies.acceleration(p); };
+			for (unsigned int i = first; i < last; ++i)
+			{
+				if (probes.live[i] == 0.0f)
+					continue;
+				glm::vec2 position(probes.x[i], probes.y[i]), velocity(probes.vx[i], probes.vy[i]);
+				glm::vec2 acceleration = bodies.acceleration(position);
+				Integrator::advance(integration, position, velocity, acceleration, probes.stepSize[i], field);
+				probes.x[i] = position.x;
+				probes.y[i] = position.y;
+				probes.vx[i] = velocity.x;
+				probes.vy[i] = velocity.y;
+			}
+			return;
+		}
+
+		// Bodies moved since the last step
+		if (Integrator::reusesAcceleration(integration.method))
+			probes.accelerate(bodies, first, last);
+		Integrator::step(integration.method, probes, first, last, integration.timeStep, [&] { probes.accelerate(bodies, first, last); });
+	}
+
+	// Steps the episodes in [first, last) once the bodies moved
+	// ---------------------------------------------------------
+	void update(const unsigned int first, const unsigned int last, const unsigned char * actions)
+	{
+		const Bodies& bodies = level->getBodies();
+		const unsigned int step = level->getStepCount();
+
+		input(first, last, actions);
+
+		// Only launched ships of running episodes move, launching ones get their launch speed first
+		for (unsigned int e = first; e < last; ++e)
+		{
+			const bool flying = status[e] == RUNNING && launchState[e] >= 1 && launchState[e] <= 3;
+			probes.live[e] = flying ? 1.0f : 0.0f;
+			if (flying && launchState[e] == 1)
+			{
+				probes.vx[e] = launchSpeed[e] * std::cos(angle[e]);
+				probes.vy[e] = launchSpeed[e] * std::sin(angle[e]);
+			}
+		}
+
+		advance(first, last);
+		for (unsigned int b = 0; b < boxesPerEpisode; ++b)
+			advance(boxLane(first, b), boxLane(last, b));
+
+		for (unsigned int e = first; e < last; ++e)
+		{
+			if (status[e] != RUNNING)
+				continue;
+
+			// Boxes land first, as they move with the level in the game
+			for (unsigned int b = 0; b < boxes[e]; ++b)
+			{
+				const unsigned int lane = boxLane(e, b);
+				if (probes.live[lane] == 0.0f)
+					continue;
+
+				const int site = bodies.collision(probes.getPosition(lane), collisionBox);
+				if (site < 0)
+					continue;
+
+				probes.live[lane] = 0.0f;
+				const int slot = bodySlot[site];
+				if (slot < 0)
+					continue;
+
+				// Scores on first terraforming, also for boxes landing in the same step
+				unsigned int& landed = terraformed[e * slots + slot];
+				if (landed == 0 || landed == step)
+				{
+					landed = step;
+					reward[e] += bodyScore[site];
+				}
+			}
+
+			switch (launchState[e])
+			{
+			case 0:
+				onPad(e);
+				break;
+
+			case 1:
+				// The launch step isn't tested for collisions
+				launchState[e] = 2;
+				break;
+
+			default:
+				angle[e] = std::atan2(probes.vy[e], probes.vx[e]);
+				if (bodies.collision(probes.getPosition(e), collisionShip) >= 0)
+				{
+					const bool boosted = launchState[e] == 3;
+					launchState[e] = 4;
+					const float reach = bodies.radius[goal] + collisionShip;
+					if (glm::distance(probes.getPosition(e), bodies.getPosition(goal)) <= reach)
+					{
+						status[e] = WON;
+						reward[e] += boosted ? 100.0f : 200.0f;
+					}
+					else
+						status[e] = CRASHED;
+				}
+			}
+
+			ticks[e] += integration.timeStep;
+			if (status[e] == RUNNING)
+			{
+				if (loseSignal(probes.getPosition(e), integration.timeStep, outside[e]))
+					status[e] = LOST;
+				else if (ticks[e] >= maxTicks)
+					status[e] = TIMEOUT;
+			}
+
+			score[e] += reward[e];
+			if (status[e] != RUNNING)
+			{
+				probes.live[e] = 0.0f;
+				for (unsigned int b = 0; b < boxesPerEpisode; ++b)
+					probes.live[boxLane(e, b)] = 0.0f;
+			}
+		}
+	}
+
+public:
+	// Constructor
+	// Arguments: level file, number of episodes, game ticks until an episode times out
+	// ----------------------------------------------------------------------------------
+	BatchEnv(const std::string filePath, const unsigned int episodes, const float maxTicks = 6000.0f)
+		: filePath(filePath), count(std::max(1u, episodes)), maxTicks(maxTicks)
+	{
+		probes.resize(count * (1 + boxesPerEpisode));
+		angle.resize(count);
+		launchAngle.resize(count);
+		launchSpeed.resize(count);
+		ticks.resize(count);
+		outside.resize(count);
+		reward.resize(count);
+		score.resize(count);
+		launchState.resize(count);
+		status.resize(count);
+		boxes.resize(count);
+		reset();
+	}
+
+	// Whether the level could be loaded, an invalid environment must not be stepped
+	bool isValid() const
+	{
+		return level && level->isValid();
+	}
+
+	// Restarts the level and puts every episode on the pad
+	// The level is loaded once, restarting binds its objects to their start again in the same body store,
+	// so pointers into the body columns stay valid
+	// -----------------------------------------------------------------------------------------------------
+	void reset()
+	{
+		if (!level)
+			level.reset(new Level(filePath));
+		if (!level->isValid())
+		{
+			std::cout << "Error: Invalid level " << filePath << std::endl;
+			return;
+		}
+		level->genPhysics();
+		integration = level->getIntegration();
+
+		// Scoring bodies in the order of the body store: planets score 100, moons 200, start and goal are terraformed
+		const unsigned int firstPlanet = (unsigned int)level->getPointMasses().size();
+		const unsigned int firstMoon = firstPlanet + (unsigned int)level->getPlanets().size();
+		const unsigned int firstBlackHole = firstMoon + (unsigned int)level->getMoons().size();
+		start = level->getTargetBody() - 1;
+		goal = level->getTargetBody();
+		bodySlot.assign(level->getBodies().size(), -1);
+		bodyScore.assign(level->getBodies().size(), 0.0f);
+		slots = 0;
+		for (unsigned int i = firstPlanet; i < firstBlackHole; ++i)
+		{
+			if (i == start || i == goal)
+				continue;
+			bodySlot[i] = slots++;
+			bodyScore[i] = i < firstMoon ? 100.0f : 200.0f;
+		}
+		terraformed.assign(count * slots, 0u);
+
+		for (unsigned int e = 0; e < count; ++e)
+			place(e, glm::radians(defaultAngle), defaultSpeed);
+	}
+
+	// Puts the episodes that ended back on the pad, the bodies carry on, returns their number
+	// -----------------------------------------------------------------------------------------
+	unsigned int resetDone()
+	{
+		unsigned int restarted = 0;
+		for (unsigned int e = 0; e < count; ++e)
+		{
+			if (status[e] == RUNNING)
+				continue;
+			place(e, launchAngle[e], launchSpeed[e]);
+			++restarted;
+		}
+		return restarted;
+	}
+
+	// Sets launch angles (radians) and speeds of the episodes still on the pad, either may be nullptr
+	// ------------------------------------------------------------------------------------------------
+	void aim(const float * angles, const float * speeds)
+	{
+		for (unsigned int e = 0; e < count; ++e)
+		{
+			if (status[e] != RUNNING || launchState[e] != 0)
+				continue;
+			if (angles)
+			{
+				launchAngle[e] = std::fmod(angles[e], twicePi);
+				if (launchAngle[e] < 0)
+					launchAngle[e] += twicePi;
+			}
+			if (speeds)
+				launchSpeed[e] = std::min(maxLaunchSpeed, std::max(minLaunchSpeed, speeds[e]));
+			onPad(e);
+		}
+	}
+
+	// Advances the level and every running episode by one physics step
+	// actions holds one combination of Action flags per episode, nullptr = no input
+	// -------------------------------------------------------------------------------
+	void step(const unsigned char * actions = nullptr)
+	{
+		if (!isValid())
+			return;
+
+		level->updatePhysics();
+		getThreadPool().parallelFor(count, [&](const unsigned int first, const unsigned int last, const unsigned int)
+		{
+			update(first, last, actions);
+		}, grain);
+	}
+
+	// Getter functions
+	unsigned int size() const
+	{
+		return count;
+	}
+	unsigned int getRunning() const
+	{
+		return (unsigned int)std::count(status.begin(), status.end(), (unsigned char)RUNNING);
+	}
+	// Game ticks per physics step
+	float getTimeStep() const
+	{
+		return integration.timeStep;
+	}
+	// Bodies all episodes fly through, in their state after the last step
+	const Bodies& getBodies() const
+	{
+		return level->getBodies();
+	}
+	const Probes& getProbes() const
+	{
+		return probes;
+	}
+	const std::vector<float>& getAngle() const
+	{
+		return angle;
+	}
+	const std::vector<float>& getLaunchSpeed() const
+	{
+		return launchSpeed;
+	}
+	const std::vector<float>& getTicks() const
+	{
+		return ticks;
+	}
+	const std::vector<float>& getReward() const
+	{
+		return reward;
+	}
+	const std::vector<float>& getScore() const
+	{
+		return score;
+	}
+	const std::vector<unsigned char>& getLaunchState() const
+	{
+		return launchState;
+	}
+	const std::vector<unsigned char>& getStatus() const
+	{
+		return status;
+	}
+	const std::vector<unsigned char>& getBoxes() const
+	{
+		return boxes;
+	}
+};
+
+#endif
@@ -0,0 +1,387 @@
+// Measures the physics kernels without opening a window
+// Compile: g++ -std=c++1z benchmark.cpp -o benchmark -O3
+// -----------------------------------------------------
+
+#include "physics.hpp"	// Body store, gravity kernels, Barnes-Hut tree
+#include "integrator.hpp"	// Time integration schemes
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cmath>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Seconds elapsed since start
+double elapsed(const Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// Random bodies and probes spread over the default window
+// -------------------------------------------------------
+Bodies randomBodies(const unsigned int n, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> posX(0.0f, 1280.0f), posY(0.0f, 720.0f), mass(1.0f, 50.0f);
+	Bodies bodies;
+	for (unsigned int i = 0; i < n; ++i)
+		bodies.add(mass(rng), 1.0f, 0.0f, glm::vec2(posX(rng), posY(rng)), glm::vec2(0.0f, 0.0f));
+	return bodies;
+}
+
+std::vector<glm::vec2> randomProbes(const unsigned int n, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> posX(0.0f, 1280.0f), posY(0.0f, 720.0f);
+	std::vector<glm::vec2> probes;
+	for (unsigned int i = 0; i < n; ++i)
+		probes.push_back(glm::vec2(posX(rng), posY(rng)));
+	return probes;
+}
+
+
+// Worst error of the SIMD kernels against the scalar path over random level layouts, see the bound in gravity.hpp
+// Relative to the sum of the absolute source terms, the quantity the bound is given for, and to the sum itself
+// ------------------------------------------------------------------------------------------------------------------
+void benchmarkKernelError(const unsigned int layouts)
+{
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<unsigned int> bodyCount(1, 64);
+
+	std::cout << "SIMD kernels vs scalar, " << layouts << " random layouts of 1 to 64 bodies, 64 probes each" << std::endl;
+	std::cout << std::setw(8) << "kernel" << std::setw(18) << "max err / |terms|" << std::setw(16) << "max err / |sum|" << std::endl;
+
+	for (const Gravity::Isa isa : { Gravity::SSE, Gravity::AVX2 })
+	{
+		if (isa > Gravity::detect())
+			continue;
+
+		const Gravity::Kernel kernel = Gravity::getKernel(isa);
+		const Gravity::FieldKernel fieldKernel = Gravity::getFieldKernel(isa);
+		std::vector<float> px(64), py(64), ax(64), ay(64);
+		double termsError = 0.0, sumError = 0.0;
+
+		for (unsigned int l = 0; l < layouts; ++l)
+		{
+			const unsigned int n = bodyCount(rng);
+			const Bodies bodies = randomBodies(n, rng);
+			const std::vector<glm::vec2> probes = randomProbes(64, rng);
+			for (unsigned int i = 0; i < 64; ++i)
+			{
+				px[i] = probes[i].x;
+				py[i] = probes[i].y;
+			}
+			fieldKernel(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n, px.data(), py.data(), ax.data(), ay.data(), 64, G);
+
+			for (unsigned int i = 0; i < 64; ++i)
+			{
+				const glm::vec2 scalar = Gravity::sumScalar(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n, probes[i], G);
+				double terms = 0.0;
+				for (unsigned int j = 0; j < n; ++j)
+					terms += glm::length(Gravity::sumScalar(&bodies.x[j], &bodies.y[j], &bodies.mass[j], 1, probes[i], G));
+
+				for (const glm::vec2 simd : { kernel(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n, probes[i], G), glm::vec2(ax[i], ay[i]) })
+				{
+					const double error = glm::length(simd - scalar);
+					termsError = std::max(termsError, error / terms);
+					sumError = std::max(sumError, error / glm::length(scalar));
+				}
+			}
+		}
+
+		std::cout << std::setw(8) << (isa == Gravity::AVX2 ? "AVX2" : "SSE") << std::setw(18) << termsError << std::setw(16) << sumError << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+
+// Barnes-Hut against direct summation
+// One tick = one tree build + one query per probe (trajectory steps and gradient cells)
+// -------------------------------------------------------------------------------------
+void benchmarkBarnesHut(const float theta, const unsigned int nProbes)
+{
+	std::mt19937 rng(42);
+	const std::vector<glm::vec2> probes = randomProbes(nProbes, rng);
+
+	std::cout << "Barnes-Hut (theta = " << theta << ") vs direct " << Gravity::getName() << " sum, " << nProbes << " probes per tick" << std::endl;
+	std::cout << std::setw(8) << "bodies" << std::setw(14) << "direct [ms]" << std::setw(14) << "tree [ms]" << std::setw(14) << "build [ms]" << std::setw(14) << "rms rel err" << std::endl;
+
+	unsigned int crossover = 0;
+
+	for (unsigned int n = 16; n <= 16384; n *= 2)
+	{
+		Bodies bodies = randomBodies(n, rng);
+		QuadTree tree;
+		std::vector<glm::vec2> direct(nProbes);
+		std::vector<glm::vec2> approximated(nProbes);
+
+		Clock::time_point start = Clock::now();
+		for (unsigned int i = 0; i < nProbes; ++i)
+			direct[i] = Gravity::sum(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n, probes[i], G);
+		const double directTime = elapsed(start);
+
+		start = Clock::now();
+		tree.build(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n);
+		const double buildTime = elapsed(start);
+
+		start = Clock::now();
+		for (unsigned int i = 0; i < nProbes; ++i)
+			approximated[i] = tree.acceleration(probes[i], theta, G);
+		const double treeTime = elapsed(start) + buildTime;
+
+		// Root mean square error relative to the root mean square acceleration
+		double squaredError = 0.0, squaredNorm = 0.0;
+		for (unsigned int i = 0; i < nProbes; ++i)
+		{
+			const glm::vec2 error = approximated[i] - direct[i];
+			squaredError += glm::dot(error, error);
+			squaredNorm += glm::dot(direct[i], direct[i]);
+		}
+		const double rmsError = std::sqrt(squaredError / squaredNorm);
+
+		if (!crossover && treeTime < directTime)
+			crossover = n;
+
+		std::cout << std::setw(8) << n << std::setw(14) << directTime * 1000.0 << std::setw(14) << treeTime * 1000.0 << std::setw(14) << buildTime * 1000.0 << std::setw(14) << rmsError << std::endl;
+	}
+
+	if (crossover)
+		std::cout << "Crossover: Barnes-Hut is faster from " << crossover << " bodies, the physics switches at " << barnesHutMinBodies(theta) << std::endl << std::endl;
+	else
+		std::cout << "Crossover: direct summation is faster for all tested sizes" << std::endl << std::endl;
+}
+
+
+// Many probes against few bodies: one sum per probe (lanes over bodies) against the field kernel (lanes over probes)
+// The batch environment steps thousands of ships through levels with a handful of bodies
+// ---------------------------------------------------------------------------------------------------------------------
+void benchmarkField(const unsigned int nProbes)
+{
+	std::mt19937 rng(42);
+	const std::vector<glm::vec2> probes = randomProbes(nProbes, rng);
+	std::vector<float> px(nProbes), py(nProbes), ax(nProbes), ay(nProbes);
+	for (unsigned int i = 0; i < nProbes; ++i)
+	{
+		px[i] = probes[i].x;
+		py[i] = probes[i].y;
+	}
+
+	std::cout << "Per-probe " << Gravity::getName() << " sum vs field kernel, " << nProbes << " probes" << std::endl;
+	std::cout << std::setw(8) << "bodies" << std::setw(14) << "sum [us]" << std::setw(14) << "field [us]" << std::setw(14) << "max rel err" << std::endl;
+
+	for (unsigned int n = 2; n <= 64; n *= 2)
+	{
+		const Bodies bodies = randomBodies(n, rng);
+		std::vector<glm::vec2> direct(nProbes);
+		const unsigned int repeats = 20;
+
+		Clock::time_point start = Clock::now();
+		for (unsigned int r = 0; r < repeats; ++r)
+		{
+			for (unsigned int i = 0; i < nProbes; ++i)
+				direct[i] = Gravity::sum(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n, probes[i], G);
+		}
+		const double sumTime = elapsed(start) / repeats;
+
+		start = Clock::now();
+		for (unsigned int r = 0; r < repeats; ++r)
+			Gravity::field(bodies.x.data(), bodies.y.data(), bodies.mass.data(), n, px.data(), py.data(), ax.data(), ay.data(), nProbes, G);
+		const double fieldTime = elapsed(start) / repeats;
+
+		double maxError = 0.0;
+		for (unsigned int i = 0; i < nProbes; ++i)
+			maxError = std::max(maxError, (double)(glm::length(glm::vec2(ax[i], ay[i]) - direct[i]) / glm::length(direct[i])));
+
+		std::cout << std::setw(8) << n << std::setw(14) << sumTime * 1e6 << std::setw(14) << fieldTime * 1e6 << std::setw(14) << maxError << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+
+// Mutual gravitation: one tick with all threads against one thread
+// A 120 Hz tick leaves 8.3 ms for everything
+// -----------------------------------------------------------------
+void benchmarkNBody()
+{
+	std::mt19937 rng(7);
+	ThreadPool singleThread(1);
+	ThreadPool& pool = getThreadPool();
+
+	std::cout << "Mutual N-body tick, " << pool.size() << " threads" << std::endl;
+	std::cout << std::setw(8) << "bodies" << std::setw(16) << "1 thread [ms]" << std::setw(16) << "pool [ms]" << std::setw(16) << "max rel err" << std::endl;
+
+	for (unsigned int n = 128; n <= 8192; n *= 2)
+	{
+		Bodies bodies = randomBodies(n, rng);
+		std::vector<float> ax(n), ay(n);
+		const unsigned int repetitions = std::max(1u, 200000u / n);
+
+		Clock::time_point start = Clock::now();
+		for (unsigned int r = 0; r < repetitions; ++r)
+			NBody::accelerate(bodies.x.data(), bodies.y.data(), bodies.mass.data(), ax.data(), ay.data(), n, G, singleThread);
+		const double singleTime = elapsed(start) / repetitions;
+
+		start = Clock::now();
+		for (unsigned int r = 0; r < repetitions; ++r)
+			NBody::accelerate(bodies.x.data(), bodies.y.data(), bodies.mass.data(), ax.data(), ay.data(), n, G, pool);
+		const double poolTime = elapsed(start) / repetitions;
+
+		// Compare a few bodies against a direct double precision sum
+		double maxError = 0.0;
+		for (unsigned int i = 0; i < n; i += n / 16)
+		{
+			double sumX = 0.0, sumY = 0.0;
+			for (unsigned int j = 0; j < n; ++j)
+			{
+				if (j == i)
+					continue;
+				const double dx = bodies.x[j] - bodies.x[i];
+				const double dy = bodies.y[j] - bodies.y[i];
+				const double r2 = dx * dx + dy * dy;
+				sumX += G * bodies.mass[j] * dx / (r2 * std::sqrt(r2));
+				sumY += G * bodies.mass[j] * dy / (r2 * std::sqrt(r2));
+			}
+			maxError = std::max(maxError, std::hypot(ax[i] - sumX, ay[i] - sumY) / std::hypot(sumX, sumY));
+		}
+
+		std::cout << std::setw(8) << n << std::setw(16) << singleTime * 1000.0 << std::setw(16) << poolTime * 1000.0 << std::setw(16) << maxError << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+
+// Accuracy and cost of the integrators on a circular orbit over 10 revolutions
+// Cost is counted in force evaluations per 1000 game ticks, the error is the worst radius deviation
+// --------------------------------------------------------------------------------------------------
+void benchmarkIntegrators()
+{
+	const float mass = 300.0f;
+	const float radius = 200.0f;
+	const float speed = std::sqrt(G * mass / radius);
+	const float period = 2.0f * 3.14159265f * radius / speed;
+	const float duration = 10.0f * period;
+
+	Bodies bodies;
+	bodies.add(mass, 0.0f, 0.0f, glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 0.0f));
+	auto field = [&bodies](const glm::vec2 p) { return bodies.acceleration(p); };
+
+	std::cout << "Integrators on a circular orbit, period " << period << " ticks, 10 revolutions" << std::endl;
+	std::cout << std::setw(10) << "method" << std::setw(8) << "dt" << std::setw(18) << "evals/1000 ticks" << std::setw(16) << "radius error" << std::setw(16) << "energy error" << std::setw(12) << "time [us]" << std::endl;
+
+	for (const Integrator::Method method : { Integrator::EULER, Integrator::LEAPFROG, Integrator::VERLET, Integrator::YOSHIDA })
+	{
+		for (float dt = 1.0f; dt <= 16.0f; dt *= 2.0f)
+		{
+			glm::vec2 position(radius, 0.0f);
+			glm::vec2 velocity(0.0f, speed);
+			glm::vec2 acceleration = field(position);
+			const unsigned int steps = (unsigned int)(duration / dt);
+			float maxError = 0.0f;
+
+			const Clock::time_point start = Clock::now();
+			for (unsigned int i = 0; i < steps; ++i)
+			{
+				Integrator::step(method, position, velocity, acceleration, dt, field);
+				maxError = std::max(maxError, std::abs(glm::length(position) - radius) / radius);
+			}
+			const double time = elapsed(start);
+
+			// Specific orbital energy v^2/2 - GM/r against its initial value
+			const float energy0 = 0.5f * speed * speed - G * mass / radius;
+			const float energy = 0.5f * glm::dot(velocity, velocity) - G * mass / glm::length(position);
+
+			std::cout << std::setw(10) << Integrator::getName(method) << std::setw(8) << dt << std::setw(18) << Integrator::getEvaluations(method) * 1000.0f / dt
+				<< std::setw(16) << maxError << std::setw(16) << std::abs((energy - energy0) / energy0) << std::setw(12) << time * 1e6 << std::endl;
+		}
+	}
+	std::cout << std::endl;
+}
+
+
+// Trajectory preview over 2000 ticks with a slingshot around a black hole (mass as in 4_blackhole.lvl)
+// The error is the final distance to a reference computed with adaptive steps at tolerance 1e-6
+// ---------------------------------------------------------------------------------------------------
+void benchmarkTrajectory()
+{
+	const float TTL = 2000.0f;
+	const glm::vec2 startPosition(-1500.0f, 200.0f);
+	const glm::vec2 startVelocity(3.0f, 0.0f);
+
+	Bodies bodies;
+	bodies.add(1700.0f, 0.0f, 0.0f, glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 0.0f));
+	unsigned int evaluations = 0;
+	auto field = [&bodies, &evaluations](const glm::vec2 p) { ++evaluations; return bodies.acceleration(p); };
+
+	// Runs the preview with the given settings, returns the final position
+	auto predict = [&](const Integrator::Settings settings)
+	{
+		glm::vec2 position = startPosition;
+		glm::vec2 velocity = startVelocity;
+		glm::vec2 acceleration = field(position);
+		float stepSize = 0.0f;
+
+		if (settings.tolerance > 0.0f)
+		{
+			for (float time = 0.0f; time < TTL;)
+				time += Integrator::adaptiveStep(position, velocity, acceleration, stepSize, std::min(50.0f, TTL - time), settings.tolerance, field);
+		}
+		else
+		{
+			for (float time = 0.0f; time < TTL; time += settings.timeStep)
+				Integrator::step(settings.method, position, velocity, acceleration, settings.timeStep, field);
+		}
+		return position;
+	};
+
+	Integrator::Settings reference;
+	reference.tolerance = 1.0e-6f;
+	const glm::vec2 exact = predict(reference);
+
+	std::cout << "Trajectory preview over " << TTL << " ticks past a black hole" << std::endl;
+	std::cout << std::setw(10) << "method" << std::setw(12) << "tolerance" << std::setw(14) << "evaluations" << std::setw(14) << "error" << std::setw(12) << "time [us]" << std::endl;
+
+	std::vector<Integrator::Settings> runs;
+	for (const Integrator::Method method : { Integrator::EULER, Integrator::VERLET, Integrator::YOSHIDA })
+	{
+		Integrator::Settings settings;
+		settings.method = method;
+		runs.push_back(settings);
+	}
+	for (const float tolerance : { 1.0e-2f, 1.0e-3f, 1.0e-4f })
+	{
+		Integrator::Settings settings;
+		settings.tolerance = tolerance;
+		runs.push_back(settings);
+	}
+
+	for (const Integrator::Settings& settings : runs)
+	{
+		evaluations = 0;
+		const Clock::time_point start = Clock::now();
+		const glm::vec2 position = predict(settings);
+		const double time = elapsed(start);
+
+		std::cout << std::setw(10) << (settings.tolerance > 0.0f ? "adaptive" : Integrator::getName(settings.method)) << std::setw(12) << settings.tolerance
+			<< std::setw(14) << evaluations << std::setw(14) << glm::length(position - exact) << std::setw(12) << time * 1e6 << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+
+int main()
+{
+	std::cout << "Gravity kernel: " << Gravity::getName() << std::endl << std::endl;
+
+	benchmarkKernelError(1000);
+	benchmarkBarnesHut(0.5f, 2000);
+	benchmarkBarnesHut(0.5f, 16000);
+	benchmarkBarnesHut(1.0f, 16000);
+	benchmarkField(4096);
+	benchmarkNBody();
+	benchmarkIntegrators();
+	benchmarkTrajectory();
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+#include <atomic>
+
+// Lock-free hand-over of the latest value from one writer thread to one reader thread
+// Writer and reader each own a slot, the third one is exchanged atomically. Neither side ever
+// waits or sees a half written value, the reader simply skips values it was too slow for.
+// --------------------------------------------------------------------------------------------
+template <typename T>
+class TripleBuffer
+{
+private:
+	static const unsigned int fresh = 4;	// Set in middle while it holds a value the reader hasn't taken
+
+	T slots[3];
+	std::atomic<unsigned int> middle;
+	unsigned int back = 1;				// Writer only
+	unsigned int front = 0;				// Reader only
+
+public:
+	TripleBuffer(const T& initial)
+		: slots{ initial, initial, initial }, middle(2)
+	{}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// Writer: slot to fill before publish(), still holds an older value
+	T& getBack()
+	{
+		return slots[back];
+	}
+
+	// Writer: hands the back slot to the reader and takes over the middle one
+	void publish()
+	{
+		back = middle.exchange(back | fresh, std::memory_order_acq_rel) & 3;
+	}
+
+	// Reader: whether a value was published since the last read()
+	bool hasNew() const
+	{
+		return middle.load(std::memory_order_relaxed) & fresh;
+	}
+
+	// Reader: newest published value, owned by the reader until the next call
+	T& read()
+	{
+		if (middle.load(std::memory_order_relaxed) & fresh)
+			front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return slots[front];
+	}
+};
+
+
+// Wait-free bounded queue for one producer and one consumer thread
+// Both sides finish in a fixed number of steps, push() fails if the queue is full
+// --------------------------------------------------------------------------------
+template <typename T, unsigned int capacity>
+class SpscQueue
+{
+private:
+	T items[capacity];
+	std::atomic<unsigned int> head{ 0 };	// Next item to pop, written by the consumer
+	std::atomic<unsigned int> tail{ 0 };	// Next free slot, written by the producer
+
+public:
+	bool push(const T& item)
+	{
+		const unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == capacity)
+			return false;
+		items[t % capacity] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		const unsigned int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h % capacity];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+#endif
@@ -1 +1,6 @@
 g++ -std=c++1z glad.c astroflight.cpp -o astroflight -O3 -s -lstdc++fs -lglfw3 -lGL -lX11 -lpthread -lXrandr -lXi -ldl -lfreetype -I/usr/local/include/freetype2 -no-pie
+g++ -std=c++1z benchmark.cpp -o benchmark -O3 -s -lpthread
+g++ -std=c++1z scanner.cpp -o scanner -O3 -s -lstdc++fs -lpthread
+g++ -std=c++1z -c astroflight_env.cpp -o astroflight_env.o -O3 -fPIC -fvisibility=hidden
+g++ -std=c++1z astroflight_env.o -o libastroflight_env.so -s -shared -lstdc++fs -lpthread
+g++ -std=c++1z headless.cpp astroflight_env.o -o headless -O3 -s -lstdc++fs -lpthread
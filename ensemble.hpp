@@ -0,0 +1,315 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "opengl.hpp"
+
+#include "glm/glm.hpp"			// Vectors
+#include "physics.hpp"			// Body store, gravity and collisions
+#include "integrator.hpp"
+#include "ephemeris.hpp"
+#include "thread_pool.hpp"		// Batches are spread over the shared pool
+#include "game_objects.hpp"		// SpaceShip
+#ifndef HEADLESS
+#include "shader.hpp"
+#endif
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+// Monte Carlo spread of the trajectory preview
+// A few hundred copies of the ship are launched with angle and speed perturbed around the player's settings.
+// The perturbations are drawn once, so the band stays put while nothing changes, and member 0 is the
+// unperturbed launch. Members are integrated in batches handed to the thread pool, each batch in lockstep
+// over the level's fixed steps against the same bodies as the Trajectory, until they hit a body or lose their
+// signal outside the window. Along the path of member 0 the band spans the lateral offsets of the central
+// members, the hit chance is the share landing on the target.
+// ------------------------------------------------------------------------------------------------------------
+class Ensemble
+{
+private:
+	const Bodies * bodies;
+	const Ephemeris * ephemeris;		// Future body positions, nullptr = bodies taken as frozen
+	const Integrator::Settings integration;
+	const unsigned int members;
+	const unsigned int steps;			// Fixed steps per member
+	const unsigned int recordInterval;	// Steps between recorded positions
+	const unsigned int slots;			// Recorded positions per member
+
+	// Launch perturbations of each member
+	std::vector<GLfloat> angleOffset;
+	std::vector<GLfloat> speedFactor;
+
+	// Recorded positions, slot s of member m at s * members + m, members stop recording once they hit something
+	std::vector<GLfloat> trackX;
+	std::vector<GLfloat> trackY;
+	std::vector<unsigned int> recorded;	// Slots recorded per member
+	std::vector<int> hit;				// Body hit by each member, -1 if none
+	std::vector<GLfloat> offsets;		// Lateral offsets from member 0, same layout as the tracks
+
+	std::vector<GLfloat> band;			// Triangle strip, the left and right edge of each slot
+	GLfloat hitChance = 0;
+
+	// Inputs of the last run, update() skips unchanged ones
+	bool cached = false;
+	GLfloat cachedAngle = 0;
+	GLfloat cachedSpeed = 0;
+	unsigned int cachedVersion = 0;
+	unsigned int cachedTarget = 0;
+
+	static constexpr GLfloat recordSpacing = 10.0f;		// Game ticks between recorded positions
+	static constexpr GLfloat angleSpread = 0.25f / 180.0f * 3.14159265f;	// Standard deviation of the launch angle
+	static constexpr GLfloat speedSpread = 0.01f;		// Standard deviation of the launch speed, relative
+	static constexpr GLfloat bandQuantile = 0.1f;		// The band leaves out this share of members on either side
+	static constexpr unsigned int batchSize = 16;		// Members integrated in lockstep by one task
+
+	// Gravity and collisions during the tick starting at a game time, like the Trajectory
+	// -------------------------------------------------------------------------------------
+	glm::vec2 accelerationAt(const glm::vec2 p, const GLfloat time) const
+	{
+		if (ephemeris)
+			return ephemeris->acceleration(ephemeris->getStep(time), p);
+		return bodies->acceleration(p);
+	}
+	int collisionAt(const glm::vec2 p, const GLfloat time) const
+	{
+		if (ephemeris)
+			return ephemeris->collision(ephemeris->getStep(time), p, collisionShip);
+		return bodies->collision(p, collisionShip);
+	}
+
+	void record(const unsigned int member, const glm::vec2 p)
+	{
+		const unsigned int slot = recorded[member]++;
+		trackX[slot * members + member] = p.x;
+		trackY[slot * members + member] = p.y;
+	}
+
+	// Integrates the members in [first, last), at most batchSize of them
+	// All members of a batch take the same step at once, so they share the bodies of that step in the cache
+	// -----------------------------------------------------------------------------------------------------
+	void integrate(const unsigned int first, const unsigned int last, const glm::vec2 center, const GLfloat axis, const GLfloat angle, const GLfloat speed)
+	{
+		glm::vec2 position[batchSize], velocity[batchSize], acceleration[batchSize];
+		GLfloat outside[batchSize];		// Game ticks spent outside the window
+		bool flying[batchSize];
+		const unsigned int n = last - first;
+
+		for (unsigned int j = 0; j < n; ++j)
+		{
+			const unsigned int m = first + j;
+			const glm::vec2 direction(std::cos(angle + angleOffset[m]), std::sin(angle + angleOffset[m]));
+			position[j] = center + axis * direction;
+			velocity[j] = speed * speedFactor[m] * direction;
+			if (Integrator::reusesAcceleration(integration.method))
+				acceleration[j] = accelerationAt(position[j], 0.0f);
+			outside[j] = 0;
+			flying[j] = true;
+			recorded[m] = 0;
+			hit[m] = -1;
+			record(m, position[j]);
+		}
+
+		for (unsigned int i = 0; i < steps; ++i)
+		{
+			const GLfloat time = i * integration.timeStep;
+			auto field = [&](const glm::vec2 p) { return accelerationAt(p, time); };
+			const bool recording = (i + 1) % recordInterval == 0;
+			bool any = false;
+
+			for (unsigned int j = 0; j < n; ++j)
+			{
+				if (!flying[j])
+					continue;
+
+				Integrator::step(integration.method, position[j], velocity[j], acceleration[j], integration.timeStep, field);
+				const int body = collisionAt(position[j], time);
+				if (body >= 0)
+				{
+					hit[first + j] = body;
+					flying[j] = false;
+					continue;
+				}
+
+				// Out of the window for too long, the member is lost as the ship would be
+				if (loseSignal(position[j], integration.timeStep, outside[j]))
+				{
+					flying[j] = false;
+					continue;
+				}
+
+				if (recording)
+					record(first + j, position[j]);
+				any = true;
+			}
+
+			if (!any)
+				break;
+		}
+	}
+
+	// Edges of the band at one slot, from the offsets of all members still flying there
+	// ----------------------------------------------------------------------------------
+	void envelope(const unsigned int slot)
+	{
+		const glm::vec2 nominal(trackX[slot * members], trackY[slot * members]);
+
+		// Normal of member 0's path from its neighbouring positions
+		const unsigned int before = slot > 0 ? slot - 1 : 0;
+		const unsigned int after = std::min(slot + 1, recorded[0] - 1);
+		glm::vec2 tangent(trackX[after * members] - trackX[before * members], trackY[after * members] - trackY[before * members]);
+		const GLfloat length = glm::length(tangent);
+		const glm::vec2 normal = length > 0.0f ? glm::vec2(-tangent.y, tangent.x) / length : glm::vec2(0.0f, 0.0f);
+
+		GLfloat * offset = &offsets[slot * members];
+		unsigned int count = 0;
+		for (unsigned int m = 0; m < members; ++m)
+		{
+			if (recorded[m] > slot)
+				offset[count++] = glm::dot(glm::vec2(trackX[slot * members + m], trackY[slot * members + m]) - nominal, normal);
+		}
+
+		const unsigned int outer = (unsigned int)(bandQuantile * count);
+		std::nth_element(offset, offset + outer, offset + count);
+		const GLfloat right = std::min(0.0f, offset[outer]);
+		std::nth_element(offset, offset + count - 1 - outer, offset + count);
+		const GLfloat left = std::max(0.0f, offset[count - 1 - outer]);
+
+		const glm::vec2 l = nominal + left * normal;
+		const glm::vec2 r = nominal + right * normal;
+		band[slot * 4] = l.x;
+		band[slot * 4 + 1] = l.y;
+		band[slot * 4 + 2] = r.x;
+		band[slot * 4 + 3] = r.y;
+	}
+
+public:
+	// Constructor
+	// Arguments: bodies and ephemeris to predict against, integrated game ticks, level integration (always
+	// taken with fixed steps), number of members
+	// ------------------------------------------------------------------------------------------------------
+	Ensemble(const Bodies& bodies, const unsigned int TTL, const Integrator::Settings integration = Integrator::Settings(), const Ephemeris * ephemeris = nullptr, const unsigned int members = 256)
+		: bodies(&bodies), ephemeris(ephemeris), integration(integration), members(std::max(1u, members)),
+		steps((unsigned int)ceil(TTL / integration.timeStep)), recordInterval(std::max(1, (int)round(recordSpacing / integration.timeStep))),
+		slots(steps / recordInterval + 1)
+	{
+		// Same perturbations for every level and run
+		std::mt19937 generator(1);
+		std::normal_distribution<GLfloat> angles(0.0f, angleSpread);
+		std::normal_distribution<GLfloat> speeds(1.0f, speedSpread);
+		angleOffset.push_back(0.0f);
+		speedFactor.push_back(1.0f);
+		for (unsigned int m = 1; m < this->members; ++m)
+		{
+			angleOffset.push_back(angles(generator));
+			speedFactor.push_back(speeds(generator));
+		}
+
+		// Everything update() writes is allocated here once
+		trackX.resize(slots * this->members);
+		trackY.resize(slots * this->members);
+		offsets.resize(slots * this->members);
+		recorded.resize(this->members);
+		hit.resize(this->members);
+		band.reserve(slots * 4);
+	}
+
+	// Launches the members around the player's settings, while the ship is still on the pad
+	// The launch settings, the version of the bodies (see Level::getStateVersion()) and the target body
+	// (see Level::getTargetBody()) key the result, unchanged inputs cost nothing.
+	// ---------------------------------------------------------------------------------------------------
+	void update(const SpaceShip& player, const unsigned int target, const unsigned int version = 0)
+	{
+		if (player.getLaunchState() > 0)
+		{
+			band.clear();
+			hitChance = 0;
+			cached = false;
+			return;
+		}
+
+		const GLfloat angle = player.getAngle();
+		const GLfloat speed = player.getLaunchSpeed();
+		if (cached && angle == cachedAngle && speed == cachedSpeed && version == cachedVersion && target == cachedTarget)
+			return;
+
+		// The ship sits on its start planet, perturbed launch angles move it around the planet
+		const GLfloat axis = player.getAxis();
+		const glm::vec2 center = player.getPosition() - axis * glm::vec2(std::cos(angle), std::sin(angle));
+
+		// Without extra threads the pool hands out everything at once, chunks are split into batches here
+		getThreadPool().parallelFor(members, [&](const unsigned int first, const unsigned int last, const unsigned int)
+		{
+			for (unsigned int batch = first; batch < last; batch += batchSize)
+				integrate(batch, std::min(last, batch + batchSize), center, axis, angle, speed);
+		}, batchSize);
+
+		// The band follows member 0 until it ends
+		band.resize(recorded[0] * 4);
+		getThreadPool().parallelFor(recorded[0], [&](const unsigned int first, const unsigned int last, const unsigned int)
+		{
+			for (unsigned int slot = first; slot < last; ++slot)
+				envelope(slot);
+		}, batchSize);
+
+		unsigned int hits = 0;
+		for (unsigned int m = 0; m < members; ++m)
+			hits += hit[m] == (int)target;
+		hitChance = (GLfloat)hits / members;
+
+		cached = true;
+		cachedAngle = angle;
+		cachedSpeed = speed;
+		cachedVersion = version;
+		cachedTarget = target;
+	}
+
+#ifndef HEADLESS
+	// Draws a band as a translucent strip around the trajectory, also used for bands copied to the render thread
+	// ------------------------------------------------------------------------------------------------------------
+	static void drawBand(const Shader& shader, const std::vector<GLfloat>& band)
+	{
+		if (band.size() < 8)
+			return;
+
+		GLuint VBO, VAO;
+		glGenBuffers(1, &VBO);
+
+		glGenVertexArrays(1, &VAO);
+		glBindVertexArray(VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * band.size(), &band.front(), GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		shader.use();
+		shader.setVec4("color", glm::vec4(114.0f / 255.0f, 191.0f / 255.0f, 68.0f / 255.0f, 0.25f));
+
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, glm::vec3(0.0f, 0.0f, -0.3f));
+		shader.setMat4("model", model);
+
+		glBindVertexArray(VAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, band.size() / 2);
+
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+	}
+#endif
+
+	// Getter functions
+	const std::vector<GLfloat>& getBand() const
+	{
+		return band;
+	}
+	// Share of the members that land on the target body
+	GLfloat getHitChance() const
+	{
+		return hitChance;
+	}
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+
+#include "glm/glm.hpp"	// Vectors
+#include "physics.hpp"	// Body store, gravity and collisions
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Precomputed future states of all level bodies, shared by everything that looks ahead
+// The bodies are integrated once, ahead of the game, in a private store. Each physics step appends
+// one state to a ring buffer and drops the oldest one, so step 0 is always the current state of the
+// level and step k the state k physics steps later. The positions of one step are contiguous, probes
+// evaluate gravity and collisions against any future step with the same kernels as the live store.
+// ----------------------------------------------------------------------------------------------------
+class Ephemeris
+{
+private:
+	Bodies future;						// State of the newest stored step
+	std::vector<float> x, y, vx, vy;	// Ring of steps, body i of slot s at s * n + i
+	unsigned int n = 0;					// Bodies per step
+	unsigned int capacity = 0;			// Stored steps
+	unsigned int first = 0;				// Slot of step 0
+	unsigned int newest = 0;			// Steps since reset() of the future store
+	float timeStep = 1.0f;				// Game ticks per step
+
+	// Copies the future store into the slot after the last stored step
+	void push(const unsigned int slot)
+	{
+		std::copy(future.x.begin(), future.x.end(), x.begin() + slot * n);
+		std::copy(future.y.begin(), future.y.end(), y.begin() + slot * n);
+		std::copy(future.vx.begin(), future.vx.end(), vx.begin() + slot * n);
+		std::copy(future.vy.begin(), future.vy.end(), vy.begin() + slot * n);
+	}
+
+	unsigned int getSlot(const unsigned int step) const
+	{
+		return (first + std::min(step, capacity - 1)) % capacity;
+	}
+
+public:
+	// Starts from the current state of a body store and precomputes steps - 1 further steps
+	// advance(store, step) has to move a store with the same layout by one physics step,
+	// step counts the physics steps since reset() the store is at afterwards
+	// ---------------------------------------------------------------------------------------
+	template <typename Advance>
+	void reset(const Bodies& bodies, const unsigned int steps, const float timeStep, const Advance& advance)
+	{
+		future = bodies;
+		n = bodies.size();
+		capacity = std::max(1u, steps);
+		first = 0;
+		newest = 0;
+		this->timeStep = timeStep;
+
+		x.resize(capacity * n);
+		y.resize(capacity * n);
+		vx.resize(capacity * n);
+		vy.resize(capacity * n);
+
+		push(0);
+		for (unsigned int slot = 1; slot < capacity; ++slot)
+		{
+			advance(future, ++newest);
+			push(slot);
+		}
+	}
+
+	// Drops the current state and computes one step at the end, the former step 1 becomes step 0
+	// -------------------------------------------------------------------------------------------
+	template <typename Advance>
+	void advance(const Advance& advance)
+	{
+		const unsigned int slot = first;
+		first = (first + 1) % capacity;
+		advance(future, ++newest);
+		push(slot);
+	}
+
+	// Copies the current state (step 0) into a body store with the same layout
+	// -------------------------------------------------------------------------
+	void read(Bodies& bodies) const
+	{
+		const unsigned int offset = first * n;
+		std::copy(x.begin() + offset, x.begin() + offset + n, bodies.x.begin());
+		std::copy(y.begin() + offset, y.begin() + offset + n, bodies.y.begin());
+		std::copy(vx.begin() + offset, vx.begin() + offset + n, bodies.vx.begin());
+		std::copy(vy.begin() + offset, vy.begin() + offset + n, bodies.vy.begin());
+	}
+
+	// Step the game moves a probe against during the tick starting at a game time
+	// The world moves before the probes, so the tick from t to t + 1 sees the bodies at t + 1.
+	// Steps beyond the horizon return the last stored one.
+	// ----------------------------------------------------------------------------------------
+	unsigned int getStep(const float time) const
+	{
+		return std::min(capacity - 1, (unsigned int)std::floor(time / timeStep) + 1);
+	}
+
+	// Sum of the gravitational accelerations of all bodies of a step at a given position
+	// ----------------------------------------------------------------------------------
+	glm::vec2 acceleration(const unsigned int step, const glm::vec2 position) const
+	{
+		const unsigned int offset = getSlot(step) * n;
+		return Gravity::sum(x.data() + offset, y.data() + offset, future.mass.data(), n, position, G);
+	}
+
+	// Collision tests of Bodies against the bodies of a step
+	// -------------------------------------------------------
+	int collision(const unsigned int step, const glm::vec2 position, const float margin) const
+	{
+		const unsigned int offset = getSlot(step) * n;
+		return Bodies::collision(x.data() + offset, y.data() + offset, future.radius.data(), n, position, margin);
+	}
+	int collision(const unsigned int step, const glm::vec2 from, const glm::vec2 to, const float margin, float& fraction) const
+	{
+		const unsigned int offset = getSlot(step) * n;
+		return Bodies::collision(x.data() + offset, y.data() + offset, future.radius.data(), n, from, to, margin, fraction);
+	}
+
+	// Getter functions
+	glm::vec2 getPosition(const unsigned int step, const unsigned int body) const
+	{
+		const unsigned int offset = getSlot(step) * n;
+		return glm::vec2(x[offset + body], y[offset + body]);
+	}
+	glm::vec2 getVelocity(const unsigned int step, const unsigned int body) const
+	{
+		const unsigned int offset = getSlot(step) * n;
+		return glm::vec2(vx[offset + body], vy[offset + body]);
+	}
+	unsigned int size() const
+	{
+		return capacity;
+	}
+};
+
+#endif
@@ -1,31 +1,55 @@
 #ifndef GAME_OBJECTS_H
 #define GAME_OBJECTS_H
 
-#include <glad/glad.h>	// OpenGL headers
+#include "opengl.hpp"		// OpenGL headers, only the types in headless builds
 #include "glm/glm.hpp"	// Vectors and transformation matrices
+#ifndef HEADLESS
 #include "shader.hpp"
+#endif
 #include "shapes.hpp"
+#include "physics.hpp"	// Body store and gravity constants
+#include "thread_pool.hpp"	// Gradient tiles are spread over the shared pool
+#include "integrator.hpp"	// Time integration schemes
+#include "ephemeris.hpp"	// Future body positions
+#include "kepler.hpp"	// Moon orbits
 
 #include <vector>
+#include <string>
+#include <iostream>
 #include <cmath>
+#include <limits>
 #include <algorithm>
 
 // Constants
-const GLfloat gameSpeed = 0.5f;
-const GLfloat gravityScale = 1.0f;				// Scales gravity force and keeps draw distance consistent
-const GLfloat G = gameSpeed * 6.6743f * gravityScale;		// Scaled gravitational constant
-const GLfloat epsilon = 0.01f * gravityScale;	// Minimal gravitational force to visualize
 const GLfloat schwartzschild = 0.067f*G;			// Multiply with mass for Schwartzschild radius, c^-2 dropped for gameplay reasons
 const GLfloat spaceShipSize = 20.0f;
 const GLfloat rotationSpeed = 1.0f / 180.0f * pi;
 const GLfloat boostPower = 2.0f;
+const GLfloat minLaunchSpeed = 1.0f;
+const GLfloat maxLaunchSpeed = 4.0f;
 const GLfloat boxSize = 5.0f;
 const GLfloat boxRotation = 1.0f / 180.0f * pi;
 const GLfloat flagSize = 15.0f;
+const GLfloat flagRotation = 0.1f / 120.0f;		// Radians per game tick, turns with the game rather than the wall clock
 const GLfloat collisionScale = 0.5f;			// Lower value = smaller collision box, negative values possible
 const GLfloat collisionShip = collisionScale * spaceShipSize * 0.17f;
 const GLfloat collisionBox = collisionScale * boxSize * 0.67f;
 const GLfloat atmosphereScale = 1.1f;
+const GLfloat windowWidth = 1280.0f;			// The game area, ships beyond it are out of bounds
+const GLfloat windowHeight = 720.0f;
+const GLfloat signalLostTicks = 5.0f * 120.0f;	// Game ticks out of bounds until the signal is lost, 5 s at 120 ticks per second
+
+
+// Counts the game ticks a ship spends out of bounds, true once its signal is lost
+// --------------------------------------------------------------------------------
+inline bool loseSignal(const glm::vec2 position, const GLfloat ticks, GLfloat & outside)
+{
+	if (position.x < -spaceShipSize || position.x > windowWidth + spaceShipSize || position.y < -spaceShipSize || position.y > windowHeight + spaceShipSize)
+		outside += ticks;
+	else
+		outside = 0;
+	return outside >= signalLostTicks;
+}
 
 
 
@@ -40,33 +64,60 @@ protected:
 	glm::vec2 position;
 	glm::vec2 velocity;
 	glm::vec2 acceleration;
+	glm::vec2 previousPosition;		// Before the last physics step, for rendering between steps
+
+	// Level body store this object is a view into, set by bind()
+	Bodies * bodyStore = nullptr;
+	unsigned int bodyIndex = 0;
+
+	// Setter functions writing through to the body store if bound
+	// -----------------------------------------------------------
+	void setPosition(const glm::vec2 newPosition)
+	{
+		if (bodyStore)
+		{
+			bodyStore->x[bodyIndex] = newPosition.x;
+			bodyStore->y[bodyIndex] = newPosition.y;
+		}
+		else
+			position = newPosition;
+	}
+	void setVelocity(const glm::vec2 newVelocity)
+	{
+		if (bodyStore)
+		{
+			bodyStore->vx[bodyIndex] = newVelocity.x;
+			bodyStore->vy[bodyIndex] = newVelocity.y;
+		}
+		else
+			velocity = newVelocity;
+	}
+	void setAcceleration(const glm::vec2 newAcceleration)
+	{
+		if (bodyStore)
+		{
+			bodyStore->ax[bodyIndex] = newAcceleration.x;
+			bodyStore->ay[bodyIndex] = newAcceleration.y;
+		}
+		else
+			acceleration = newAcceleration;
+	}
 
 	// Calculating the gravitational force applied by another point mass, doesn't consider own mass
 	// --------------------------------------------------------------------------------------------
 	glm::vec2 gravitationalAcceleration(const PointMass& other) const
 	{
-		glm::vec2 rv = other.getPosition() - this->position;	// Distance vector pointing to the other mass
+		glm::vec2 rv = other.getPosition() - getPosition();		// Distance vector pointing to the other mass
 		GLfloat rl = glm::length(rv);							// Length of distance vector
 		return G * other.getMass() / (rl * rl * rl) * rv;
 	}
 
-	// Calculating the centrifugal force applied by another point mass
-	// ---------------------------------------------------------------
-	glm::vec2 centrifugalAcceleration(const PointMass& other) const
-	{
-		glm::vec2 rv = this->position - other.getPosition();	// Distance vector pointing away from the other mass
-		GLfloat angle = glm::dot(rv, this->velocity);			// Apply centrifugal force if velocity vector is orthogonal
-		GLfloat vl = glm::length(velocity);
-		return angle < epsilon ? vl * vl / glm::length(rv) * glm::normalize(rv) : glm::vec2(0.0f, 0.0f);
-	}
-
-
-	// Acceleration depends on which forces are supposed to affect the object
-	virtual void accelerate() {}
 
+#ifndef HEADLESS
 	// Drawing a disk for a planet (z = 0) or gravity field (z = 0.5)
-	// --------------------------------------------------------------
-	void drawDisk(const Shader& shader, const GLfloat radius, const GLfloat z = 0.0f) const
+	// alpha blends between the previous (0) and the current (1) physics step
+	// ----------------------------------------------------------------------
+	void drawDisk(const Shader& shader, const GLfloat radius, const GLfloat z = 0.0f, const GLfloat alpha = 1.0f) const
 	{
 		// Getting the vertices of the disk
 		GLfloat * vertices = getDisk();
@@ -88,7 +139,8 @@ protected:
 		shader.use();
 
 		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(position.x, position.y, z));
+		const glm::vec2 center = getRenderPosition(alpha);
+		model = glm::translate(model, glm::vec3(center.x, center.y, z));
 		model = glm::scale(model, glm::vec3(radius, radius, 0.0f));
 		shader.setMat4("model", model);
 
@@ -100,6 +152,7 @@ protected:
 		glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
 	}
+#endif
 
 
 public:
@@ -112,26 +165,56 @@ public:
 	{
 		position = glm::vec2(px, py);
 		velocity = glm::vec2(vx, vy);
+		previousPosition = position;
+	}
+
+	// Binds the object to a body store, the store holds its position and velocity from now on
+	// -----------------------------------------------------------------------------------------
+	void bind(Bodies& store)
+	{
+		bodyIndex = store.add(mass, radius, gravRadius, position, velocity);
+		bodyStore = &store;
+	}
+
+	// Points a bound object at another store with the same layout, e.g. the one of a copied level
+	// --------------------------------------------------------------------------------------------
+	void view(Bodies& store)
+	{
+		if (bodyStore)
+			bodyStore = &store;
 	}
 
+	// Acceleration depends on which forces are supposed to affect the object
+	virtual void accelerate() {}
+
 	// Moves the point of mass
 	// -----------------------
 	virtual void move()
 	{
 		accelerate();
-		velocity += acceleration;
+		setVelocity(getVelocity() + getAcceleration());
 
 		// Check for collision
 		// glm::vec2 newPosition = position + velocity;
-		position += velocity;
+		setPosition(getPosition() + getVelocity());
 	}
 	
+	// Keeps the current state as the previous one, called before every physics step
+	// Bound objects are saved with their body store
+	// -------------------------------------------------------------------------------
+	virtual void saveState()
+	{
+		previousPosition = position;
+	}
+
+#ifndef HEADLESS
 	// Draws the gravity field
 	// -----------------------
-	void drawField(const Shader& shader) const
+	void drawField(const Shader& shader, const GLfloat alpha = 1.0f) const
 	{
-		drawDisk(shader, getGravRadius(), -0.5f);
+		drawDisk(shader, getGravRadius(), -0.5f, alpha);
 	}
+#endif
 
 	// Needed for planets and moons
 	virtual void setTerraforming(unsigned int value) {}
@@ -139,14 +222,27 @@ public:
 	// Getter functions
 	glm::vec2 getPosition() const
 	{
+		if (bodyStore)
+			return bodyStore->getPosition(bodyIndex);
 		return position;
 	}
+	// Position blended between the previous and the current physics step
+	glm::vec2 getRenderPosition(const GLfloat alpha) const
+	{
+		if (bodyStore)
+			return bodyStore->getPosition(bodyIndex, alpha);
+		return previousPosition + alpha * (position - previousPosition);
+	}
 	glm::vec2 getVelocity() const
 	{
+		if (bodyStore)
+			return bodyStore->getVelocity(bodyIndex);
 		return velocity;
 	}
 	glm::vec2 getAcceleration() const
 	{
+		if (bodyStore)
+			return glm::vec2(bodyStore->ax[bodyIndex], bodyStore->ay[bodyIndex]);
 		return acceleration;
 	}
 	GLfloat getMass() const
@@ -175,7 +271,7 @@ class Planet : public PointMass
 {
 protected:
 	const glm::vec3 color;
-	GLuint terraforming = 0;
+	GLfloat terraforming = 0;		// Atmosphere in percent, grows by one per game tick once started
 
 public:
 	// Constructor
@@ -186,28 +282,32 @@ public:
 		this->radius = radius;
 	};
 
+#ifndef HEADLESS
 	// Draws the planet
 	// ----------------
-	void draw(const Shader& shader) const
+	void draw(const Shader& shader, const GLfloat alpha = 1.0f) const
 	{
 		shader.use();
 		shader.setVec3("color", color);
-		drawDisk(shader, radius);
+		drawDisk(shader, radius, 0.0f, alpha);
 	}
 
 	// Draws the atmosphere
 	// --------------------
-	void drawAtmosphere(const Shader& shader) const
+	void drawAtmosphere(const Shader& shader, const GLfloat alpha = 1.0f) const
 	{
 		shader.use();
 		shader.setVec3("color", glm::vec3(0.0f, 0.0f, 1.0f));
-		drawDisk(shader, radius * atmosphereScale * terraforming / 100, 0.5f);
+		drawDisk(shader, radius * atmosphereScale * terraforming / 100, 0.5f, alpha);
 	}
+#endif
 
-	void accelerate()
+	// Grows the atmosphere once terraforming has started, by the game ticks of one physics step
+	// ------------------------------------------------------------------------------------------
+	void terraform(const GLfloat ticks = 1.0f)
 	{
 		if (terraforming > 0 && terraforming < 100)
-			++terraforming;
+			terraforming = std::min(100.0f, terraforming + ticks);
 	}
 
 	void setTerraforming(const unsigned int value)
@@ -216,12 +316,18 @@ public:
 			terraforming = value;
 	}
 
+	// Takes over the state that changes during play, the position lives in the body store
+	void copyState(const Planet& other)
+	{
+		terraforming = other.terraforming;
+	}
+
 	// Getter functions
 	float getRadius() const
 	{
 		return radius;
 	}
-	GLuint getTerraforming() const
+	GLfloat getTerraforming() const
 	{
 		return terraforming;
 	}
@@ -237,13 +343,14 @@ public:
 class Moon : public Planet
 {
 private:
-	const Planet& refPlanet;
+	unsigned int planetBody;	// Body store index of the reference planet, copies of the level stay valid
+	Kepler::Orbit orbit;		// Relative to the planet, starting at the position given in the level
 
 public:
 	// Constructor
 	// -----------
-	Moon(const GLfloat mass, const GLfloat radius, const GLfloat r, const GLfloat g, const GLfloat b, const Planet& refPlanet, const GLfloat distance, const GLfloat angle, const bool clockwise)
-		: Planet(mass, radius, r, g, b, 0, 0), refPlanet(refPlanet)
+	Moon(const GLfloat mass, const GLfloat radius, const GLfloat r, const GLfloat g, const GLfloat b, const Planet& refPlanet, const unsigned int planetBody, const GLfloat distance, const GLfloat angle, const bool clockwise)
+		: Planet(mass, radius, r, g, b, 0, 0), planetBody(planetBody)
 	{
 		if (refPlanet.getMass() < mass * 2)
 		{
@@ -258,14 +365,25 @@ public:
 		// Find orthogonal unit vector, reverse if !clockwise, find v = sqrt(GM/r)
 		const GLfloat orthogonalAngle = clockwise ? angle - halfPi : angle + halfPi;
 		velocity = (GLfloat)sqrt(G * refPlanet.getMass() / distance) * glm::vec2(cos(orthogonalAngle), sin(orthogonalAngle));
+
+		if (!Kepler::fromState(position - refPlanet.getPosition(), velocity, G * refPlanet.getMass(), orbit))
+		{
+			std::cout << "Error: Moon's orbit is not bound" << std::endl;
+		}
 	}
 
-	void accelerate()
+	// Places the moon on its orbit around the planet's entry in a store with the level's layout
+	// Arguments: body store (the level's or the ephemeris'), game ticks since the level started
+	// -----------------------------------------------------------------------------------------
+	void propagate(Bodies& store, const double time) const
 	{
-		acceleration = gravitationalAcceleration(refPlanet) + centrifugalAcceleration(refPlanet);
+		glm::vec2 relativePosition, relativeVelocity;
+		Kepler::state(orbit, time, relativePosition, relativeVelocity);
 
-		if (terraforming > 0 && terraforming < 100)
-			++terraforming;
+		store.x[bodyIndex] = store.x[planetBody] + relativePosition.x;
+		store.y[bodyIndex] = store.y[planetBody] + relativePosition.y;
+		store.vx[bodyIndex] = store.vx[planetBody] + relativeVelocity.x;
+		store.vy[bodyIndex] = store.vy[planetBody] + relativeVelocity.y;
 	}
 	
 	std::string getType() const
@@ -288,16 +406,18 @@ public:
 	{}
 
 
-	void draw(const Shader& shaderHole, const Shader& shaderHorizon)
+#ifndef HEADLESS
+	void draw(const Shader& shaderHole, const Shader& shaderHorizon, const GLfloat alpha = 1.0f)
 	{
 		shaderHorizon.use();
 		shaderHorizon.setVec3("color", glm::vec3(1.0f));
-		drawDisk(shaderHorizon, radius * 1.2f, 0.4f);
+		drawDisk(shaderHorizon, radius * 1.2f, 0.4f, alpha);
 		
 		shaderHole.use();
 		shaderHole.setVec3("color", color);
-		drawDisk(shaderHole, radius * 1.1f, 0.6f);
+		drawDisk(shaderHole, radius * 1.1f, 0.6f, alpha);
 	}
+#endif
 };
 
 
@@ -309,10 +429,12 @@ private:
 	Planet * startPlanet;
 	GLfloat axis;
 	GLfloat angle;
+	GLfloat previousAngle;
 	GLfloat launchAngle;
 	GLfloat launchSpeed;
 	unsigned int launchState = 0;	// 0 not launched, 1 launching, 2 launched, 3 boosted, 4 landed
 	bool boosted = false;
+	GLfloat stepSize = 0;			// Proposed adaptive step, carried between ticks
 
 public:
 	SpaceShip(Planet& startPlanet, GLfloat angle = 90.0f)
@@ -322,6 +444,7 @@ public:
 		GLfloat posX = startPlanet.getPosition().x + (GLfloat)cos(angle) * axis;
 		GLfloat posY = startPlanet.getPosition().y + (GLfloat)sin(angle) * axis;
 		position = glm::vec2(posX, posY);
+		saveState();
 
 		// Find minimal launch speed to exit gravity pull
 		// launchSpeed = ceil(glm::length(gravitationalAcceleration(startPlanet)) * 50);
@@ -355,20 +478,15 @@ public:
 
 	}
 
-	void accelerate(std::vector<PointMass*> pointMasses)
+	void accelerate(const Bodies& bodies)
 	{
-		acceleration = glm::vec2(0.0f, 0.0f);
-
-		for (PointMass* pm : pointMasses)
-		{
-			acceleration += gravitationalAcceleration(*pm);
-			//acceleration += centrifugalAcceleration(*pm);
-		}
+		acceleration = bodies.acceleration(position);
 	}
 
-	void move(std::vector<PointMass*> pointMasses)
+	void move(const Bodies& bodies, const Integrator::Settings& integration = Integrator::Settings())
 	{
 		GLfloat posX, posY;
+		auto field = [&bodies](const glm::vec2 p) { return bodies.acceleration(p); };
 
 		switch (launchState)
 		{
@@ -378,14 +496,15 @@ public:
 			posX = startPlanet->getPosition().x + (GLfloat)cos(angle) * axis;
 			posY = startPlanet->getPosition().y + (GLfloat)sin(angle) * axis;
 			position = glm::vec2(posX, posY);
+			stepSize = 0;
 			break;
 
 		case 1:
 			velocity.x = launchSpeed * (GLfloat)cos(angle);
 			velocity.y = launchSpeed * (GLfloat)sin(angle);
-			accelerate(pointMasses);
-			velocity += acceleration;
-			position += velocity;
+			if (Integrator::reusesAcceleration(integration))
+				accelerate(bodies);
+			Integrator::advance(integration, position, velocity, acceleration, stepSize, field);
 			++launchState;
 			break;
 
@@ -394,25 +513,26 @@ public:
 		
 		// case 2 and 3
 		default:
-			accelerate(pointMasses);
-			velocity += acceleration;
+			if (Integrator::reusesAcceleration(integration))
+				accelerate(bodies);		// Bodies moved since the last step
+			Integrator::advance(integration, position, velocity, acceleration, stepSize, field);
 			angle = atan2(velocity.y, velocity.x);	// rotation
-			position += velocity;
 
 			// Check for collision
-			for (PointMass* pm : pointMasses)
-			{
-				if (glm::distance(position, pm->getPosition()) - pm->getRadius() <= collisionShip)
-				{
-					launchState = 4;
-				}
-			}
+			if (bodies.collision(position, collisionShip) >= 0)
+				launchState = 4;
 		}
 	}
 
-	void rotate(bool clockwise, bool precisionMode)
+	void saveState()
+	{
+		previousPosition = position;
+		previousAngle = angle;
+	}
+
+	void rotate(bool clockwise, bool precisionMode, const GLfloat timeStep = 1.0f)
 	{
-		const GLfloat precisionScale = precisionMode ? 0.1f : 1.0f;
+		const GLfloat precisionScale = (precisionMode ? 0.1f : 1.0f) * timeStep;
 
 		if (launchState == 0)
 		{
@@ -443,15 +563,33 @@ public:
 				launchSpeed -= precisionScale;
 			}
 		}
-		if (launchSpeed < 1)
-			launchSpeed = 1;
-		else if (launchSpeed > 4.0)
-			launchSpeed = 4.0;
+		if (launchSpeed < minLaunchSpeed)
+			launchSpeed = minLaunchSpeed;
+		else if (launchSpeed > maxLaunchSpeed)
+			launchSpeed = maxLaunchSpeed;
 	}
 
+	// Sets launch angle (radians) and speed at once while on the pad, e.g. to a solution of the AutoAim
+	void aim(const GLfloat launchAngle, const GLfloat launchSpeed)
+	{
+		if (launchState != 0)
+			return;
 
-	void draw(const Shader& shader) const
+		angle = std::fmod(launchAngle, twicePi);
+		if (angle < 0)
+			angle += twicePi;
+		this->launchAngle = angle;
+		this->launchSpeed = std::min(maxLaunchSpeed, std::max(minLaunchSpeed, launchSpeed));
+	}
+
+
+#ifndef HEADLESS
+	void draw(const Shader& shader, const GLfloat alpha = 1.0f) const
 	{
+		// Blend the pose between the physics steps, turning the short way round
+		const glm::vec2 renderPosition = getRenderPosition(alpha);
+		const GLfloat renderAngle = previousAngle + alpha * (GLfloat)std::remainder(angle - previousAngle, 2.0f * pi);
+
 		// Getting the vertices of the disk
 		GLfloat * vertices = getSpaceShip();
 
@@ -473,8 +611,8 @@ public:
 		shader.setVec3("color", glm::vec3(200.0f, 200.0f, 200.0f));
 
 		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(position.x, position.y, 0.5f));
-		model = glm::rotate(model, angle, glm::vec3(0.0f, 0.0f, 1.0f));
+		model = glm::translate(model, glm::vec3(renderPosition.x, renderPosition.y, 0.5f));
+		model = glm::rotate(model, renderAngle, glm::vec3(0.0f, 0.0f, 1.0f));
 		model = glm::scale(model, glm::vec3(spaceShipSize, spaceShipSize, 0.0f));
 		shader.setMat4("model", model);
 
@@ -486,6 +624,7 @@ public:
 		glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
 	}
+#endif
 
 
 	void setPlanet(Planet& newPlanet, const bool reset = false)
@@ -498,6 +637,7 @@ public:
 		GLfloat posX = startPlanet->getPosition().x + (GLfloat)cos(angle) * axis;
 		GLfloat posY = startPlanet->getPosition().y + (GLfloat)sin(angle) * axis;
 		position = glm::vec2(posX, posY);
+		saveState();		// No blending from the old level
 		if (not reset)
 			launchSpeed = ceil(glm::length(gravitationalAcceleration(*startPlanet)) * 50);
 	}
@@ -518,6 +658,11 @@ public:
 	{
 		return launchSpeed;
 	}
+	// Distance from the center of the start planet while on the pad
+	GLfloat getAxis() const
+	{
+		return axis;
+	}
 	bool hasBoosted() const
 	{
 		return boosted;
@@ -529,76 +674,628 @@ public:
 // ------------------------------------------------------------------------
 class Trajectory : public PointMass
 {
+public:
+	// Why a prediction stopped before the horizon, OPEN if it didn't (yet)
+	enum Outcome { OPEN, IMPACT, ESCAPE, ORBIT };
+
+	static constexpr unsigned int maxSamples = 4096;	// Vertices of the line strip, longer paths end there
+
 private:
 	const SpaceShip& player;
-	std::vector<PointMass*> pointMasses;
-	std::vector<GLfloat> samples;
-	const unsigned int TTL;
+	const Bodies * bodies;
+	const Ephemeris * ephemeris = nullptr;	// Future body positions, nullptr = bodies taken as frozen
+	std::vector<GLfloat> samples;		// Line strip, x and y of each vertex, reserved for maxSamples once
+	const unsigned int TTL;				// In game ticks, integrated step by step
+	unsigned int horizon;				// In game ticks, extended beyond TTL with patched conics
+	Integrator::Settings integration;
+	GLfloat time = 0;					// Game ticks predicted so far
+	GLfloat nextCheck = 0;				// Game time of the next escape test
+
+	// Integrator state kept between updates, a prediction can be continued where it stopped
+	GLfloat stepSize = 0;				// Proposed adaptive step
+	unsigned int fixedStep = 0;			// Next step of fixed step methods
+	unsigned int tracedStep = 0;		// Last fixed step added to the samples, with its state
+	glm::vec2 tracedPosition;
+	glm::vec2 tracedVelocity;
+	bool patching = false;				// Beyond TTL, see movePatched()
+	unsigned int stepBudget = 0;		// Steps per update(), 0 = unlimited
+	unsigned int budget = 0;			// Steps left in the current update()
+	unsigned int origin = 0;			// Version of the bodies the prediction started from
+	GLfloat lag = 0;					// Game ticks the ephemeris moved on since then
+
+	// Inputs of the last prediction, update() only recomputes what they don't cover
+	bool cached = false;
+	glm::vec2 cachedPosition;
+	glm::vec2 cachedVelocity;
+	unsigned int cachedVersion = 0;
+	unsigned int cachedHorizon = 0;
+	Outcome outcome = OPEN;				// Of the last prediction, anything but OPEN ends it
+
+	// Cone of directions from the last fixed vertex that pass close enough to every point since, see sample()
+	glm::vec2 anchor;
+	bool aimed = false;					// The cone is open until a point lies beyond the tolerance
+	glm::vec2 rightEdge;				// Unit directions bounding the cone, counterclockwise from right to left
+	glm::vec2 leftEdge;
+	GLfloat reach = 0;					// Farthest distance of a point from the anchor
+	bool full = false;					// No vertex left, the prediction ends
+
+	// State the ship has to come back to on a closed orbit, taken once the bodies stand still
+	bool hasReference = false;
+	glm::vec2 referencePosition;
+	glm::vec2 referenceVelocity;
+
+	static constexpr GLfloat checkSpacing = 10.0f;	// Game ticks between escape tests and between the points of conic arcs
+	static constexpr GLfloat sampleTolerance = 0.5f;	// Largest distance of the path from the line strip in pixels
+	static constexpr unsigned int maxPieces = 16;	// Points per step or arc segment at most
+	static constexpr GLfloat maxStep = 50.0f;		// Longest adaptive step in game ticks
+	static constexpr GLfloat conicTolerance = 1.0e-3f;	// Adaptive steps between conics if the level has fixed steps
+	static constexpr GLfloat returnDistance = 5.0f;		// Closed orbits come back this close to the reference position
+	static constexpr GLfloat returnSpeed = 5.0e-2f;		// and velocity, relative to the reference speed (long adaptive steps are interpolated)
+
+	// Takes one step from the budget, false if it is used up or the line strip is full
+	bool spend()
+	{
+		if (budget == 0 || full)
+			return false;
+		--budget;
+		return true;
+	}
 
 	void accelerate()
 	{
-		acceleration = glm::vec2(0.0f, 0.0f);
+		acceleration = accelerationAt(position, time);
+	}
 
-		for (auto & pm : pointMasses)
-			acceleration += gravitationalAcceleration(*pm);
+	// Ephemeris step of the tick starting at a game time of the prediction
+	unsigned int stepAt(const GLfloat time) const
+	{
+		return ephemeris->getStep(std::max(0.0f, time - lag));
 	}
 
-	void move()
+	// Gravity and collisions during the tick starting at a game time
+	// ---------------------------------------------------------------
+	glm::vec2 accelerationAt(const glm::vec2 p, const GLfloat time) const
+	{
+		if (ephemeris)
+			return ephemeris->acceleration(stepAt(time), p);
+		return bodies->acceleration(p);
+	}
+	int collisionAt(const glm::vec2 p, const GLfloat time) const
+	{
+		if (ephemeris)
+			return ephemeris->collision(stepAt(time), p, collisionShip);
+		return bodies->collision(p, collisionShip);
+	}
+	int collisionAt(const glm::vec2 from, const glm::vec2 to, const GLfloat time, GLfloat& fraction) const
+	{
+		if (ephemeris)
+			return ephemeris->collision(stepAt(time), from, to, collisionShip, fraction);
+		return bodies->collision(from, to, collisionShip, fraction);
+	}
+
+	// Position and velocity of a body during the tick starting at a game time
+	// Bodies beyond the ephemeris are frozen like the gravity they exert
+	// -----------------------------------------------------------------------
+	void bodyState(const unsigned int body, const GLfloat time, glm::vec2& p, glm::vec2& v) const
 	{
-		for (unsigned int i = 0; i < TTL || (i >= TTL && samples.size() % 4 == 0); ++i)
+		v = glm::vec2(0.0f, 0.0f);
+		if (!ephemeris)
 		{
-			accelerate();
-			velocity += acceleration;
-			position += velocity;
+			p = bodies->getPosition(body);
+			return;
+		}
+
+		const unsigned int step = stepAt(time);
+		p = ephemeris->getPosition(step, body);
+		if (step + 1 < ephemeris->size())
+			v = ephemeris->getVelocity(step, body);
+	}
+
+	// The only body whose sphere of influence (gravRadius) contains the position, -1 if none or several
+	// -------------------------------------------------------------------------------------------------
+	int dominantBody(const glm::vec2 p, const GLfloat time) const
+	{
+		int dominant = -1;
+		for (unsigned int i = 0; i < bodies->size(); ++i)
+		{
+			glm::vec2 center, centerVelocity;
+			bodyState(i, time, center, centerVelocity);
+			if (glm::length(p - center) >= bodies->gravRadius[i])
+				continue;
+			if (dominant >= 0)
+				return -1;
+			dominant = (int)i;
+		}
+		return dominant;
+	}
+
+	// Whether the bodies stand still in the prediction from a game time on, only then paths can repeat
+	// -------------------------------------------------------------------------------------------------
+	bool frozenAt(const GLfloat time) const
+	{
+		return !ephemeris || stepAt(time) + 1 >= ephemeris->size();
+	}
+
+	// Whether the ship left every sphere of influence, moves away from all bodies and can't be pulled back
+	// ------------------------------------------------------------------------------------------------------
+	bool escaped() const
+	{
+		GLfloat potential = 0;
+		for (unsigned int i = 0; i < bodies->size(); ++i)
+		{
+			glm::vec2 center, centerVelocity;
+			bodyState(i, time, center, centerVelocity);
+			const glm::vec2 d = position - center;
+			const GLfloat r = glm::length(d);
+			if (r <= bodies->gravRadius[i] || glm::dot(d, velocity - centerVelocity) <= 0.0f)
+				return false;
+			potential += G * bodies->mass[i] / r;
+		}
+		return 0.5f * glm::dot(velocity, velocity) > potential;
+	}
+
+	// Whether the step from an old state over h ticks came back to the reference state
+	// The step has to cross the line through the reference position normal to its velocity in the same
+	// direction (a Poincare section), close enough to the reference position and with a similar velocity.
+	// -------------------------------------------------------------------------------------------------------
+	bool returned(const glm::vec2 oldPosition, const glm::vec2 oldVelocity, const GLfloat h)
+	{
+		if (!frozenAt(time))
+			return false;
+		if (!hasReference)
+		{
+			hasReference = true;
+			referencePosition = position;
+			referenceVelocity = velocity;
+			return false;
+		}
 
-			if (i % 10 == 0)
+		const GLfloat before = glm::dot(oldPosition - referencePosition, referenceVelocity);
+		const GLfloat after = glm::dot(position - referencePosition, referenceVelocity);
+		if (before >= 0.0f || after < 0.0f)
+			return false;
+
+		const GLfloat fraction = before / (before - after);
+		const glm::vec2 crossing = Integrator::interpolate(oldPosition, oldVelocity, position, velocity, h, fraction);
+		const glm::vec2 crossingVelocity = oldVelocity + fraction * (velocity - oldVelocity);
+		return glm::length(crossing - referencePosition) <= returnDistance
+			&& glm::length(crossingVelocity - referenceVelocity) <= returnSpeed * glm::length(referenceVelocity);
+	}
+
+	// Whether the step from an old state over h ticks ends the prediction early
+	// Escapes are only looked for every checkSpacing ticks, the test costs about as much as a step
+	// ----------------------------------------------------------------------------------------------
+	Outcome settle(const glm::vec2 oldPosition, const glm::vec2 oldVelocity, const GLfloat h)
+	{
+		const bool check = time >= nextCheck;
+		if (check)
+			nextCheck = time + checkSpacing;
+
+		if (check && escaped())
+			return ESCAPE;
+		if (returned(oldPosition, oldVelocity, h))
+			return ORBIT;
+		return OPEN;
+	}
+
+	// Whether a straight line from the anchor can pass within the tolerance of a point and of all points
+	// since the anchor, narrows the cone of such lines if so
+	// -----------------------------------------------------------------------------------------------------
+	bool fits(const glm::vec2 p)
+	{
+		const glm::vec2 d = p - anchor;
+		const GLfloat distance = glm::length(d);
+		// Turning back would leave the farthest point behind the end of the line
+		if (distance < reach - sampleTolerance)
+			return false;
+		if (distance <= sampleTolerance)
+			return true;
+
+		// Lines passing within the tolerance of the point, turned by asin(tolerance / distance) to either side
+		const glm::vec2 u = d / distance;
+		const glm::vec2 normal(-u.y, u.x);
+		const GLfloat s = sampleTolerance / distance;
+		const GLfloat c = std::sqrt(1.0f - s * s);
+		const glm::vec2 right = c * u - s * normal;
+		const glm::vec2 left = c * u + s * normal;
+		if (!aimed)
+		{
+			aimed = true;
+			rightEdge = right;
+			leftEdge = left;
+			reach = distance;
+			return true;
+		}
+
+		// The line ends at this point, so its own direction has to stay inside the cone as well
+		if (cross(rightEdge, u) < 0.0f || cross(u, leftEdge) < 0.0f)
+			return false;
+
+		if (cross(rightEdge, right) > 0.0f)
+			rightEdge = right;
+		if (cross(left, leftEdge) > 0.0f)
+			leftEdge = left;
+		reach = std::max(reach, distance);
+		return true;
+	}
+
+	// Extends the line strip to the next point of the path
+	// The last vertex follows the path while a straight line from the vertex before stays within the
+	// tolerance of every point in between. Once it can't, the last vertex stays and a new one follows,
+	// so straight coasts take few vertices and tight turns many. The store never grows beyond maxSamples.
+	// -----------------------------------------------------------------------------------------------------
+	void sample(const glm::vec2 p)
+	{
+		if (!fits(p))
+		{
+			if (samples.size() >= 2 * maxSamples)
 			{
-				samples.push_back(position.x);
-				samples.push_back(position.y);
+				full = true;
+				return;
 			}
 
+			anchor = glm::vec2(samples[samples.size() - 2], samples[samples.size() - 1]);
+			aimed = false;
+			reach = 0;
+			samples.push_back(p.x);
+			samples.push_back(p.y);
+			fits(p);
+			return;
+		}
+
+		samples[samples.size() - 2] = p.x;
+		samples[samples.size() - 1] = p.y;
+	}
+
+	static GLfloat cross(const glm::vec2 a, const glm::vec2 b)
+	{
+		return a.x * b.y - a.y * b.x;
+	}
+
+	// Points a piece of the path between two states has to be split into to stay within the tolerance
+	// A piece of length l whose velocity turns by an angle a bulges about l a / 8 from its chord
+	// -------------------------------------------------------------------------------------------------
+	unsigned int pieces(const glm::vec2 from, const glm::vec2 fromVelocity, const glm::vec2 to, const glm::vec2 toVelocity) const
+	{
+		// Most steps barely turn, a < pi / 2 sin(a) below a right angle bounds the bulge without trigonometry
+		const glm::vec2 chord = to - from;
+		const GLfloat sine = cross(fromVelocity, toVelocity);
+		const GLfloat bound = 8.0f / 1.5707964f * sampleTolerance;
+		if (glm::dot(fromVelocity, toVelocity) >= 0.0f && glm::dot(chord, chord) * sine * sine <= bound * bound * glm::dot(fromVelocity, fromVelocity) * glm::dot(toVelocity, toVelocity))
+			return 1;
+
+		const GLfloat turn = std::atan2(std::abs(sine), glm::dot(fromVelocity, toVelocity));
+		const GLfloat bulge = glm::length(chord) * turn / 8.0f;
+		// Splitting in n pieces divides both length and turn by n
+		return std::min(maxPieces, std::max(1u, (unsigned int)std::ceil(std::sqrt(bulge / sampleTolerance))));
+	}
+
+	// Samples the step from an old state over h ticks up to a fraction of it, interpolated where it turns
+	// ----------------------------------------------------------------------------------------------------
+	void trace(const glm::vec2 oldPosition, const glm::vec2 oldVelocity, const GLfloat h, const GLfloat fraction = 1.0f)
+	{
+		const unsigned int n = pieces(oldPosition, oldVelocity, position, velocity);
+		for (unsigned int i = 1; i < n; ++i)
+			sample(Integrator::interpolate(oldPosition, oldVelocity, position, velocity, h, fraction * i / n));
+		// The chord up to an impact, like the collision test
+		sample(fraction < 1.0f ? oldPosition + fraction * (position - oldPosition) : position);
+	}
+
+	// One adaptive step of at most limit ticks, returns OPEN unless the prediction ends there
+	// Collisions are tested along each step, the path ends at the impact
+	// ---------------------------------------------------------------------------------------
+	Outcome adaptiveStep(GLfloat& stepSize, const GLfloat tolerance, const GLfloat limit)
+	{
+		auto field = [this](const glm::vec2 p) { return accelerationAt(p, time); };
+		const glm::vec2 oldPosition = position;
+		const glm::vec2 oldVelocity = velocity;
+		const GLfloat h = Integrator::adaptiveStep(position, velocity, acceleration, stepSize, limit, tolerance, field);
+
+		GLfloat fraction;
+		const bool hit = collisionAt(oldPosition, position, time, fraction) >= 0;
+		trace(oldPosition, oldVelocity, h, fraction);
+		if (hit)
+			return IMPACT;
+
+		time += h;
+		return settle(oldPosition, oldVelocity, h);
+	}
+
+	// Integrates up to TTL, returns OPEN unless the prediction ended early
+	// Both stop when the budget is used up, the next call continues from there
+	// ------------------------------------------------------------------------
+	Outcome moveAdaptive()
+	{
+		while (time < TTL)
+		{
+			if (!spend())
+				return OPEN;
+			const Outcome result = adaptiveStep(stepSize, integration.tolerance, maxStep);
+			if (result != OPEN)
+				return result;
+		}
+		return OPEN;
+	}
+
+	Outcome moveFixed()
+	{
+		// Same game time for every time step, the path is traced every checkSpacing ticks and where the
+		// prediction ends, interpolated in between like one long step
+		const unsigned int steps = (unsigned int)ceil(TTL / integration.timeStep);
+		const unsigned int traceInterval = std::max(1, (int)round(checkSpacing / integration.timeStep));
+		auto field = [this](const glm::vec2 p) { return accelerationAt(p, time); };
+		auto traceTo = [this](const unsigned int step)
+		{
+			if (step == tracedStep)
+				return;
+			trace(tracedPosition, tracedVelocity, (step - tracedStep) * integration.timeStep);
+			tracedStep = step;
+			tracedPosition = position;
+			tracedVelocity = velocity;
+		};
+
+		for (; fixedStep < steps; ++fixedStep)
+		{
+			if (!spend())
+				return OPEN;
+
+			const unsigned int i = fixedStep;
+			const glm::vec2 oldPosition = position;
+			const glm::vec2 oldVelocity = velocity;
+			time = i * integration.timeStep;
+			Integrator::step(integration.method, position, velocity, acceleration, integration.timeStep, field);
+
 			// Check for collision
-			for (PointMass* pm : pointMasses)
+			const Outcome result = collisionAt(position, time) >= 0 ? IMPACT : settle(oldPosition, oldVelocity, integration.timeStep);
+			if (result != OPEN || (i + 1) % traceInterval == 0)
+				traceTo(i + 1);
+			if (result != OPEN)
+				return result;
+		}
+
+		traceTo(steps);
+		time = steps * integration.timeStep;
+		return OPEN;
+	}
+
+	// Whether the path from -> to enters the sphere of influence of a body other than the dominant one
+	// ------------------------------------------------------------------------------------------------
+	bool entersSphere(const glm::vec2 from, const glm::vec2 to, const GLfloat time, const int dominant) const
+	{
+		for (unsigned int i = 0; i < bodies->size(); ++i)
+		{
+			if ((int)i == dominant)
+				continue;
+
+			glm::vec2 center, centerVelocity;
+			GLfloat fraction;
+			bodyState(i, time, center, centerVelocity);
+			if (Bodies::collision(&center.x, &center.y, &bodies->gravRadius[i], 1, from, to, 0.0f, fraction) >= 0)
+				return true;
+		}
+		return false;
+	}
+
+	// Extends the prediction from TTL to the horizon with patched conics, returns OPEN unless it ended early
+	// While the ship is in the sphere of influence of a single body only that body's gravity counts, so the
+	// path is a conic section around it and whole arcs are evaluated in closed form (see kepler.hpp). The
+	// body keeps its current velocity during the arc. Outside or where spheres overlap it's integrated.
+	// ---------------------------------------------------------------------------------------------------------
+	Outcome movePatched()
+	{
+		const GLfloat tolerance = integration.tolerance > 0.0f ? integration.tolerance : conicTolerance;
+
+		while (time < horizon)
+		{
+			if (!spend())
+				return OPEN;
+
+			const int body = dominantBody(position, time);
+			Kepler::Orbit orbit;
+			glm::vec2 center, centerVelocity;
+
+			if (body >= 0)
+				bodyState(body, time, center, centerVelocity);
+
+			if (body >= 0 && Kepler::fromState(position - center, velocity - centerVelocity, G * bodies->mass[body], orbit))
 			{
-				if (glm::distance(position, pm->getPosition()) - pm->getRadius() <= collisionShip)
+				const double exit = Kepler::timeToRadius(orbit, bodies->gravRadius[body], true);
+				const double impact = Kepler::timeToRadius(orbit, bodies->radius[body] + collisionShip, false);
+				// An ellipse that neither leaves the sphere nor hits the body repeats after one period
+				const double period = Kepler::twoPi / orbit.meanMotion;
+				const bool closed = orbit.e < 1 && exit == Kepler::never && impact == Kepler::never && frozenAt(time) && period < horizon - time;
+				const GLfloat end = (GLfloat)std::min(std::min(exit, impact), closed ? period : (double)(horizon - time));
+				const bool hit = impact <= exit && impact <= horizon - time;
+
+				// Walk the arc checkSpacing ticks at a time, it ends early where it enters another sphere of
+				// influence or where the budget is used up, every point after the first costs one step
+				GLfloat done = 0;
+				bool entered = false;
+				bool paused = false;
+				glm::vec2 from = position, fromVelocity = velocity, p, v;
+				while (done < end)
 				{
-					samples.push_back(position.x);
-					samples.push_back(position.y);
+					if (done > 0 && !spend())
+					{
+						paused = true;
+						break;
+					}
+
+					const GLfloat next = std::min(end, done + checkSpacing);
+					Kepler::state(orbit, next, p, v);
+					p += center + next * centerVelocity;
+					v += centerVelocity;
+					if (entersSphere(from, p, time + done, body))
+					{
+						entered = true;
+						break;
+					}
+
+					// Points in between where the arc turns, close to the body
+					const unsigned int n = pieces(from, fromVelocity, p, v);
+					for (unsigned int i = 1; i < n; ++i)
+					{
+						const GLfloat t = done + (next - done) * i / n;
+						glm::vec2 q, u;
+						Kepler::state(orbit, t, q, u);
+						sample(center + t * centerVelocity + q);
+					}
+					sample(p);
+					from = p;
+					fromVelocity = v;
+					done = next;
+				}
 
-					if (samples.size() % 4 == 2)
-						return;
+				// Arcs too short to advance the game time (e.g. right at the edge of the sphere) are integrated instead
+				if (time + done > time)
+				{
+					Kepler::state(orbit, done, p, v);
+					position = center + done * centerVelocity + p;
+					velocity = centerVelocity + v;
+					time += done;
+
+					if ((hit || closed) && !entered && !paused)
+						return hit ? IMPACT : ORBIT;
+
+					stepSize = 0;
+					accelerate();
+					if (!entered)
+						continue;
 				}
 			}
+
+			// Integrated where no single body dominates, where arcs enter another sphere or are too short
+			const Outcome result = adaptiveStep(stepSize, tolerance, std::min(maxStep, horizon - time));
+			if (result != OPEN)
+				return result;
+		}
+		return OPEN;
+	}
+
+	// Starts a new prediction from a position and velocity
+	// -----------------------------------------------------
+	void restart(const glm::vec2 startPosition, const glm::vec2 startVelocity)
+	{
+		// The strip starts with a vertex at the start and one following the path
+		samples.clear();
+		samples.insert(samples.end(), { startPosition.x, startPosition.y, startPosition.x, startPosition.y });
+		anchor = startPosition;
+		aimed = false;
+		reach = 0;
+		full = false;
+
+		position = startPosition;
+		velocity = startVelocity;
+		time = 0;
+		lag = 0;
+		nextCheck = 0;
+		stepSize = 0;
+		fixedStep = 0;
+		tracedStep = 0;
+		tracedPosition = startPosition;
+		tracedVelocity = startVelocity;
+		patching = false;
+		outcome = OPEN;
+		hasReference = false;
+
+		if (integration.tolerance > 0.0f || Integrator::reusesAcceleration(integration.method))
+			accelerate();
+	}
+
+	// Continues the prediction until the horizon, a hit or the end of the budget
+	// ---------------------------------------------------------------------------
+	void move()
+	{
+		budget = stepBudget ? stepBudget : std::numeric_limits<unsigned int>::max();
+
+		if (outcome == OPEN && time < TTL)
+			outcome = integration.tolerance > 0.0f ? moveAdaptive() : moveFixed();
+		if (outcome == OPEN && time >= TTL && horizon > TTL)
+		{
+			if (!patching)
+			{
+				patching = true;
+				stepSize = 0;
+				accelerate();
+			}
+			outcome = movePatched();
 		}
 	}
 
 public:
-	Trajectory(const SpaceShip& player, const std::vector<PointMass*> pointMasses, const unsigned int TTL)
-		: PointMass(0, 0, 0), player(player), pointMasses(pointMasses), TTL(TTL)
+	Trajectory(const SpaceShip& player, const Bodies& bodies, const unsigned int TTL, const Integrator::Settings integration = Integrator::Settings(), const Ephemeris * ephemeris = nullptr, const unsigned int stepBudget = 0)
+		: PointMass(0, 0, 0), player(player), bodies(&bodies), ephemeris(ephemeris), TTL(TTL), horizon(TTL), integration(integration), stepBudget(stepBudget)
 	{
+		samples.reserve(2 * maxSamples);
 		update();
 	}
 
-	void update()
+	// Predicts the path from the player's current state
+	// The start state (launch angle and speed) and the version of the bodies (see Level::getStateVersion())
+	// key the cached prediction: unchanged inputs cost nothing, a longer horizon only computes the extension.
+	// With a step budget each call computes at most that many steps, the path grows over successive calls
+	// until isComplete() and starts over as soon as an input changes. On moving levels the version and the
+	// ship on its pad move on every tick, a prediction of the same launch is finished first against the
+	// ephemeris shifted by the steps since it started, else it would start over every tick and never complete.
+	// -------------------------------------------------------------------------------------------------------
+	void update(const unsigned int version = 0)
 	{
-		samples.clear();
-
-		position = player.getPosition();
+		glm::vec2 startPosition = player.getPosition();
+		glm::vec2 startVelocity;
 
 		if (player.getLaunchState() > 0)
-			velocity = player.getVelocity();
+			startVelocity = player.getVelocity();
 		else
 		{
-			velocity.x = player.getLaunchSpeed() * (GLfloat)cos(player.getAngle());
-			velocity.y = player.getLaunchSpeed() * (GLfloat)sin(player.getAngle());
+			startVelocity.x = player.getLaunchSpeed() * (GLfloat)cos(player.getAngle());
+			startVelocity.y = player.getLaunchSpeed() * (GLfloat)sin(player.getAngle());
+		}
+
+		const bool sameStart = cached && startPosition == cachedPosition && startVelocity == cachedVelocity && version == cachedVersion;
+		if (sameStart && horizon >= cachedHorizon && isComplete())
+			return;
+
+		// Only the bodies moved on, finish the prediction while the ephemeris still holds the step it continues from
+		const GLfloat behind = (version - origin) * integration.timeStep;
+		const bool catchUp = cached && !isComplete() && ephemeris && version > origin && startVelocity == cachedVelocity && horizon >= cachedHorizon && time >= behind;
+
+		// Otherwise continue where the last prediction stopped, unless it started elsewhere or went too far
+		if (catchUp)
+			lag = behind;
+		else if (!sameStart || horizon < cachedHorizon)
+		{
+			restart(startPosition, startVelocity);
+			origin = version;
 		}
-		
 		move();
+
+		cached = true;
+		cachedPosition = startPosition;
+		cachedVelocity = startVelocity;
+		cachedVersion = version;
+		cachedHorizon = horizon;
 	}
 
+	// Whether the prediction reached the horizon, ended early or filled the line strip, false while a step budget holds it back
+	bool isComplete() const
+	{
+		return outcome != OPEN || time >= horizon || full;
+	}
+
+
+#ifndef HEADLESS
+	void draw(const Shader& shader) const
+	{
+		drawSamples(shader, samples);
+	}
 
-	void draw(Shader shader)
+	// Draws the samples as a line strip, also used for trajectories copied to the render thread
+	// -------------------------------------------------------------------------------------------
+	static void drawSamples(const Shader& shader, const std::vector<GLfloat>& samples)
 	{
+		if (samples.empty())
+			return;
+
 		GLuint VBO, VAO;
 		glGenBuffers(1, &VBO);
 
@@ -608,7 +1305,7 @@ public:
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * samples.size(), &samples.front(), GL_STATIC_DRAW);
 
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)(2*sizeof(float)));
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
 		glEnableVertexAttribArray(0);
 
 		shader.use();
@@ -619,15 +1316,50 @@ public:
 		shader.setMat4("model", model);
 
 		glBindVertexArray(VAO);
-		glDrawArrays(GL_LINES, 0, samples.size());
+		glDrawArrays(GL_LINE_STRIP, 0, samples.size() / 2);
 
 		glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
 	}
+#endif
 
-	void setPointMassPointer(const std::vector<PointMass*> pointMasses)
+	void setBodies(const Bodies& bodies)
 	{
-		this->pointMasses = pointMasses;
+		this->bodies = &bodies;
+		cached = false;
+	}
+
+	void setEphemeris(const Ephemeris * ephemeris)
+	{
+		this->ephemeris = ephemeris;
+		cached = false;
+	}
+
+	void setIntegration(const Integrator::Settings integration)
+	{
+		this->integration = integration;
+		cached = false;
+	}
+
+	// Steps computed per update() at most, 0 = unlimited
+	void setStepBudget(const unsigned int steps)
+	{
+		stepBudget = steps;
+	}
+
+	// Game ticks to predict, beyond TTL the prediction continues with patched conics
+	void setHorizon(const unsigned int ticks)
+	{
+		horizon = std::max(ticks, TTL);
+	}
+
+	const std::vector<GLfloat>& getSamples() const
+	{
+		return samples;
+	}
+	Outcome getOutcome() const
+	{
+		return outcome;
 	}
 };
 
@@ -636,30 +1368,35 @@ public:
 class Box : public PointMass
 {
 private:
-	const std::vector<PointMass*> pointMasses;
+	const Bodies * bodies;
+	const Integrator::Settings integration;
 	GLfloat rotation = 0;
+	GLfloat previousRotation = 0;
 	bool landed = false;
 	bool processed = false;
+	int landingSite = -1;	// Index of the body the box landed on
+	GLfloat stepSize = 0;	// Proposed adaptive step, carried between ticks
 	glm::vec2 restDirection;
 
-	void accelerate(std::vector<PointMass*> pointMasses)
-	{
-		acceleration = glm::vec2(0.0f, 0.0f);
-		for (PointMass* pm : pointMasses)
-			acceleration += gravitationalAcceleration(*pm);
-	}
-
-
 public:
-	Box(const SpaceShip& player, const std::vector<PointMass*> pointMasses)
-		: PointMass(0, player.getPosition().x, player.getPosition().y), pointMasses(pointMasses), restDirection(-player.getVelocity())
+	Box(const SpaceShip& player, const Bodies& bodies, const Integrator::Settings integration = Integrator::Settings())
+		: PointMass(0, player.getPosition().x, player.getPosition().y), bodies(&bodies), integration(integration), restDirection(-player.getVelocity())
 	{}
 
 	void accelerate()
 	{
-		acceleration = glm::vec2(0.0f, 0.0f);
-		for (PointMass* pm : pointMasses)
-			acceleration += gravitationalAcceleration(*pm);
+		acceleration = bodies->acceleration(position);
+	}
+
+	void saveState()
+	{
+		previousPosition = position;
+		previousRotation = rotation;
+	}
+
+	void setBodies(const Bodies& bodies)
+	{
+		this->bodies = &bodies;
 	}
 
 	void move()
@@ -667,31 +1404,34 @@ public:
 		if (landed)
 			return;
 
-		accelerate();
-		const GLfloat angle = glm::length(velocity) == 0 ? glm::dot(acceleration, restDirection) : glm::dot(acceleration, velocity);
-		rotation += angle;
-		velocity += acceleration;
+		if (Integrator::reusesAcceleration(integration))
+			accelerate();		// Bodies moved since the last step
 
-		glm::vec2 newPosition = position + velocity;
-		// Check for collision
-		for (PointMass* pm : pointMasses)
-		{
-			if (glm::distance(newPosition, pm->getPosition()) - pm->getRadius() <= collisionBox)
-			{
-				landed = true;
-				pm->setTerraforming(1);
-			}
-		}
+		const glm::vec2 oldVelocity = velocity;
+		glm::vec2 newPosition = position;
+		Integrator::advance(integration, newPosition, velocity, acceleration, stepSize, [this](const glm::vec2 p) { return bodies->acceleration(p); });
+
+		const GLfloat angle = glm::length(oldVelocity) == 0 ? glm::dot(acceleration, restDirection) : glm::dot(acceleration, oldVelocity);
+		rotation += angle * integration.timeStep;
+
+		// Check for collision, the level terraforms the body at landingSite
+		landingSite = bodies->collision(newPosition, collisionBox);
+		if (landingSite >= 0)
+			landed = true;
 
-		position += velocity;
+		position = newPosition;
 	}
 
 
-	void draw(const Shader& shader) const
+#ifndef HEADLESS
+	void draw(const Shader& shader, const GLfloat alpha = 1.0f) const
 	{
 		if (landed)
 			return;
 
+		const glm::vec2 renderPosition = getRenderPosition(alpha);
+		const GLfloat renderRotation = previousRotation + alpha * (rotation - previousRotation);
+
 		// Getting the vertices of the box
 		GLfloat * vertices = getBox();
 
@@ -713,8 +1453,8 @@ public:
 		shader.setVec3("color", glm::vec3(152.0f, 80.0f, 6.0f));
 
 		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(position.x, position.y, 0.5f));
-		model = glm::rotate(model, rotation, glm::vec3(0.0f, 0.0f, 1.0f));
+		model = glm::translate(model, glm::vec3(renderPosition.x, renderPosition.y, 0.5f));
+		model = glm::rotate(model, renderRotation, glm::vec3(0.0f, 0.0f, 1.0f));
 		model = glm::scale(model, glm::vec3(boxSize, boxSize, 0.0f));
 		shader.setMat4("model", model);
 
@@ -726,6 +1466,7 @@ public:
 		glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
 	}
+#endif
 
 	void process()
 	{
@@ -736,6 +1477,10 @@ public:
 	{
 		return landed;
 	}
+	int getLandingSite() const
+	{
+		return landingSite;
+	}
 	bool isProcessed() const
 	{
 		return processed;
@@ -749,28 +1494,46 @@ class Flag
 {
 private:
 	Planet * goal;
+	GLfloat goalRadius;		// Copied so drawing never touches the planet, which may live on another thread
 	glm::vec2 position;
 	GLfloat time;
+	glm::vec2 previousPosition;
+	GLfloat previousTime;
 
 public:
 	Flag(Planet& goal)
-		: goal(&goal), position(goal.getPosition()), time(-(GLfloat)glfwGetTime() * 0.1f + 1.6f)
-	{}
+		: goal(&goal), goalRadius(goal.getRadius()), position(goal.getPosition()), time(1.6f)
+	{
+		saveState();
+	}
 
 	void setPlanet(Planet& newPlanet)
 	{
 		this->goal = &newPlanet;
+		goalRadius = goal->getRadius();
 		position = goal->getPosition();
+		saveState();
 	}
 
-	void move()
+	void saveState()
+	{
+		previousPosition = position;
+		previousTime = time;
+	}
+
+	// Arguments: game ticks since the last call
+	void move(const GLfloat ticks = 1.0f)
 	{
 		position = goal->getPosition();
-		time = -(GLfloat)glfwGetTime() * 0.1f + 1.6f;
+		time -= flagRotation * ticks;
 	}
 
-	void draw(const Shader& shader)
+#ifndef HEADLESS
+	void draw(const Shader& shader, const GLfloat alpha = 1.0f)
 	{
+		const glm::vec2 renderPosition = previousPosition + alpha * (position - previousPosition);
+		const GLfloat renderTime = previousTime + alpha * (time - previousTime);
+
 		shader.use();
 
 		// Getting the vertices of the flag
@@ -798,8 +1561,8 @@ public:
 
 		// Loading the shader and transforming the pole
 		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(position.x + (flagSize + goal->getRadius()) * cos(time), position.y + (flagSize + goal->getRadius()) * sin(time), 0.0f));
-		model = glm::rotate(model, time + halfPi, glm::vec3(0.0f, 0.0f, 1.0f));
+		model = glm::translate(model, glm::vec3(renderPosition.x + (flagSize + goalRadius) * cos(renderTime), renderPosition.y + (flagSize + goalRadius) * sin(renderTime), 0.0f));
+		model = glm::rotate(model, renderTime + halfPi, glm::vec3(0.0f, 0.0f, 1.0f));
 		model = glm::scale(model, glm::vec3(flagSize, flagSize, 0.0f));
 		shader.setMat4("model", model);
 		shader.setVec3("color", glm::vec3(178.0f, 178.0f, 178.0f));
@@ -810,8 +1573,8 @@ public:
 
 		// Transforming the flag
 		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(position.x + (flagSize * 0.9f + goal->getRadius()) * cos(time), position.y + (flagSize + 0.3f + goal->getRadius()) * sin(time), 0.0f));
-		model = glm::rotate(model, time - halfPi, glm::vec3(0.0f, 0.0f, 1.0f));
+		model = glm::translate(model, glm::vec3(renderPosition.x + (flagSize * 0.9f + goalRadius) * cos(renderTime), renderPosition.y + (flagSize + 0.3f + goalRadius) * sin(renderTime), 0.0f));
+		model = glm::rotate(model, renderTime - halfPi, glm::vec3(0.0f, 0.0f, 1.0f));
 		model = glm::scale(model, glm::vec3(flagSize, flagSize, 0.0f));
 		shader.setMat4("model", model);
 		shader.setVec3("color", glm::vec3(239.0f, 35.0f, 31.0f));
@@ -824,6 +1587,7 @@ public:
 		glDeleteVertexArrays(2, VAO);
 		glDeleteBuffers(2, VBO);
 	}
+#endif
 };
 
 
@@ -835,23 +1599,25 @@ public:
 	CenterOfMass() : PointMass(0, 0, 0)	{}
 
 	// Find center of mass for given point masses
-	void update(const std::vector<PointMass*>& pointMasses)
+	void update(const Bodies& bodies)
 	{
 		int M = 0;
-		for(auto &pm : pointMasses)
+		for (unsigned int i = 0; i < bodies.size(); ++i)
 		{
-			M += (int)pm->getMass();
-			position += pm->getMass() * pm->getPosition();
+			M += (int)bodies.mass[i];
+			position += bodies.mass[i] * bodies.getPosition(i);
 		}
 		position /= M;
 	}
 
+#ifndef HEADLESS
 	void draw(const Shader& shader) const
 	{
 		shader.use();
 		shader.setVec3("color", glm::vec3(255.0f, 255.0f, 0.0f));
 		drawDisk(shader, 10, 0.7f);
 	}
+#endif
 };
 
 
@@ -889,117 +1655,346 @@ public:
 };
 
 // Draws a gradient rectangle showing the absolute gravitional force
+// The grid is sampled in tiles of columns spread over the thread pool, each tile sums the gravity at all of
+// its samples at once with the field kernels (see gravity.hpp)
 class GravGradient
 {
 private:
 	std::vector<GLfloat> vertices;
 
-	// Calculating the gravitational force applied by another point mass
-	glm::vec2 gravitationalAcceleration(const glm::vec2 position, PointMass& other) const
+	// Samples column by column, sample y of column x at y + rows * x
+	unsigned int columns = 0;
+	unsigned int rows = 0;
+	GLfloat width = 0;
+	GLfloat height = 0;
+	std::vector<GLfloat> sampleX;
+	std::vector<GLfloat> sampleY;
+	std::vector<GLfloat> accelerationX;
+	std::vector<GLfloat> accelerationY;
+	std::vector<GLfloat> forces;			// Outside bodies only
+	std::vector<GLfloat> cappedForces;
+	std::vector<unsigned char> inside;
+
+	// Per tile: force of its last sample outside all bodies (-1 if none), the same before the tile, range of the forces
+	std::vector<GLfloat> tileLast;
+	std::vector<GLfloat> tileCarry;
+	std::vector<GLfloat> tileMin;
+	std::vector<GLfloat> tileMax;
+	std::vector<unsigned int> tileVersion;		// Body version the tile was sampled at
+	std::vector<unsigned char> tileChanged;		// Forces of the tile changed in this update
+	std::vector<unsigned int> refresh;			// Tiles sampled in this update
+
+	// Bodies the samples follow, a new body version whenever they change
+	std::vector<GLfloat> bodyX;
+	std::vector<GLfloat> bodyY;
+	std::vector<GLfloat> bodyMass;
+	std::vector<GLfloat> bodyRadius;
+	unsigned int bodyVersion = 0;
+
+	unsigned int staleness = 1;		// Updates until every tile has caught up with the bodies
+	unsigned int cursor = 0;		// First tile of the next rotating refresh
+	unsigned int version = 0;		// Counts the rebuilds of the vertices
+	GLfloat slope = 0.0f;			// Normalization of the current vertices
+	GLfloat yIntercept = 0.0f;
+
+	static constexpr unsigned int tileColumns = 8;		// Grid columns per task
+	static constexpr unsigned int unsampled = ~0u;		// Version of tiles without samples
+	static constexpr GLfloat maxForce = 0.03f;			// Cap of the force to even out huge differences
+	static constexpr GLfloat colorTolerance = 1.0f / 128.0f;	// Color drift a stale normalization may cause, two steps of 8 bit
+
+	unsigned int getTiles(const unsigned int count) const
 	{
-		glm::vec2 rv = other.getPosition() - position;		// Distance vector pointing to the other mass
-		GLfloat rl = glm::length(rv);						// Length of distance vector
-		return G * other.getMass() / (rl * rl * rl) * rv;
+		return (count + tileColumns - 1) / tileColumns;
 	}
 
-public:
-	// Calculates the force in each points and generates the vertices vector
-	void update(const GLfloat scrWidth, const GLfloat scrHeight, GLuint xCount, GLuint yCount, std::vector<PointMass*>& pointMasses)
+	// Places the samples, only when the resolution changes
+	// ----------------------------------------------------
+	void layout(const GLfloat scrWidth, const GLfloat scrHeight, const unsigned int xCount, const unsigned int yCount)
 	{
-		vertices.clear();
+		if (xCount == columns && yCount == rows && scrWidth == width && scrHeight == height)
+			return;
 
-		if (xCount == 0)
-			xCount = 2;
-		else if (xCount % 2 == 1)
-			++xCount;
-		if (yCount == 0)
-			yCount = 2;
-		else if (yCount % 2 == 1)
-			++yCount;
+		columns = xCount;
+		rows = yCount;
+		width = scrWidth;
+		height = scrHeight;
 
+		// Positions are accumulated like the original loops over the window did
 		const GLfloat xOffset = scrWidth / (GLfloat)(xCount-1);
 		const GLfloat yOffset = scrHeight / (GLfloat)(yCount-1);
-		
-		std::vector<glm::vec2> positions;
-		std::vector<GLfloat> forces;
-
-		glm::vec2 position;
-		glm::vec2 force;
-
-		bool insidePlanet;
-		GLfloat lastForce;	// Applied when position is inside planet for smoother transitions
+		std::vector<GLfloat> xs(columns), ys(rows);
+		GLfloat position = 0.0f;
+		for (auto & x : xs)
+		{
+			x = position;
+			position += xOffset;
+		}
+		position = 0.0f;
+		for (auto & y : ys)
+		{
+			y = position;
+			position += yOffset;
+		}
 
-		// Get the absolute gravitional force for each point
-		for (GLfloat x = 0.0f; x < scrWidth + 0.5f*xOffset; x += xOffset)
+		const unsigned int samples = columns * rows;
+		sampleX.resize(samples);
+		sampleY.resize(samples);
+		for (unsigned int x = 0; x < columns; ++x)
 		{
-			for (GLfloat y = 0.0f; y < scrHeight + 0.5f*yOffset; y += yOffset)
+			for (unsigned int y = 0; y < rows; ++y)
 			{
-				position = glm::vec2(x, y);
-				force = glm::vec2(0.0f);
-				insidePlanet = false;
+				sampleX[y + rows * x] = xs[x];
+				sampleY[y + rows * x] = ys[y];
+			}
+		}
+		accelerationX.resize(samples);
+		accelerationY.resize(samples);
+		forces.resize(samples);
+		cappedForces.resize(samples);
+		inside.resize(samples);
+
+		const unsigned int tiles = getTiles(columns);
+		tileLast.resize(tiles);
+		tileCarry.assign(tiles, -1.0f);
+		tileMin.resize(tiles);
+		tileMax.resize(tiles);
+		tileVersion.assign(tiles, unsampled);
+		tileChanged.resize(tiles);
+		cursor = 0;
+		vertices.resize((columns - 1) * (rows - 1) * 24);
+	}
 
-				for (auto& pm : pointMasses)
-				{
-					if (glm::distance(position, pm->getPosition()) - pm->getRadius() < epsilon)
-					{
-						insidePlanet = true;
-						force = glm::vec2(sqrt(lastForce));
-						break;
-					}
+	// Compares the bodies with the ones the samples follow and takes them over if they changed
+	// Returns the furthest distance a body moved, infinity if bodies were added, removed or resized
+	// ----------------------------------------------------------------------------------------------
+	GLfloat track(const Bodies& bodies)
+	{
+		const unsigned int count = bodies.size();
+		bool changed = count != bodyX.size();
+		GLfloat moved = changed ? std::numeric_limits<GLfloat>::infinity() : 0.0f;
 
-					force += gravitationalAcceleration(position, *pm);
-				}
+		for (unsigned int i = 0; i < count && count == bodyX.size(); ++i)
+		{
+			const bool resized = bodies.mass[i] != bodyMass[i] || bodies.radius[i] != bodyRadius[i];
+			const bool shifted = bodies.x[i] != bodyX[i] || bodies.y[i] != bodyY[i];
+			if (resized)
+				moved = std::numeric_limits<GLfloat>::infinity();
+			else if (shifted)
+				moved = std::max(moved, glm::length(glm::vec2(bodies.x[i] - bodyX[i], bodies.y[i] - bodyY[i])));
+			changed |= resized || shifted;
+		}
+		if (!changed)
+			return 0.0f;
+
+		bodyX.assign(bodies.x.begin(), bodies.x.end());
+		bodyY.assign(bodies.y.begin(), bodies.y.end());
+		bodyMass.assign(bodies.mass.begin(), bodies.mass.end());
+		bodyRadius.assign(bodies.radius.begin(), bodies.radius.end());
+		++bodyVersion;
+		return moved;
+	}
 
-				if (!insidePlanet)
-					lastForce = glm::length(force);
+	// Gravity at the samples of a tile, leaves the force of its last sample outside all bodies in tileLast
+	// ----------------------------------------------------------------------------------------------------
+	void sample(const unsigned int tile, const Bodies& bodies)
+	{
+		const unsigned int first = tile * tileColumns * rows;
+		const unsigned int last = std::min(columns, (tile + 1) * tileColumns) * rows;
+		bodies.acceleration(&sampleX[first], &sampleY[first], &accelerationX[first], &accelerationY[first], last - first);
 
-				positions.push_back(position);
-				if (glm::length(force) > 0.03f)	// Cap the max force to 0.03f to even out huge differences
-					forces.push_back(0.03f);
-				else
-					forces.push_back(glm::length(force));
+		// Same test as Bodies::collision(), bodies in the outer loop so the samples form vectors
+		std::fill(inside.begin() + first, inside.begin() + last, 0);
+		for (unsigned int i = 0; i < bodies.size(); ++i)
+		{
+			const GLfloat bodyX = bodies.x[i], bodyY = bodies.y[i], radius = bodies.radius[i];
+			for (unsigned int k = first; k < last; ++k)
+			{
+				const GLfloat dx = bodyX - sampleX[k];
+				const GLfloat dy = bodyY - sampleY[k];
+				inside[k] |= std::sqrt(dx * dx + dy * dy) - radius <= epsilon;
 			}
 		}
 
-		// Find normalizing function [minForce, maxForce] -> [-1, 1]: 2.0f * (slope * x + yIntercept)
-		const GLfloat minForce = *std::min_element(forces.begin(), forces.end());
-		const GLfloat slope = 1.0f / (*std::max_element(forces.begin(), forces.end()) - minForce);	// Interval of length 1 with slope = 1/(maxForce-minForce)
-		const GLfloat yIntercept = -(slope * minForce) - 0.5f;										// Move interval to [-0.5, 0.5]
+		GLfloat lastForce = -1.0f;
+		for (unsigned int k = first; k < last; ++k)
+		{
+			if (!inside[k])
+			{
+				forces[k] = glm::length(glm::vec2(accelerationX[k], accelerationY[k]));
+				lastForce = forces[k];
+			}
+		}
+		tileLast[tile] = lastForce;
+		tileVersion[tile] = bodyVersion;
+	}
 
-		// Normalize the forces vector
-		std::transform(forces.begin(), forces.end(), forces.begin(), [&slope, &yIntercept](GLfloat x) { return 2.0f * (slope * x + yIntercept); });
-		
-		/*
-		for (const auto& i : forces)
-			std::cout << i << std::endl;
-		std::cout << std::endl;
-		*/
+	// Fills the samples inside bodies with the force of the last sample outside before them and caps all forces
+	// Arguments: tile, force of the last sample outside before the tile
+	// -----------------------------------------------------------------------------------------------------------
+	void cap(const unsigned int tile, GLfloat lastForce)
+	{
+		const unsigned int first = tile * tileColumns * rows;
+		const unsigned int last = std::min(columns, (tile + 1) * tileColumns) * rows;
+		GLfloat minForce = maxForce, maxForceSeen = 0.0f;
+
+		for (unsigned int k = first; k < last; ++k)
+		{
+			GLfloat force;
+			if (inside[k])
+				force = glm::length(glm::vec2(std::sqrt(lastForce)));	// Smoother transitions into bodies
+			else
+			{
+				force = forces[k];
+				lastForce = force;
+			}
 
-		// Generate the vertices vector
-		int currentSamples [6];
+			cappedForces[k] = force > maxForce ? maxForce : force;
+			minForce = std::min(minForce, cappedForces[k]);
+			maxForceSeen = std::max(maxForceSeen, cappedForces[k]);
+		}
+		tileMin[tile] = minForce;
+		tileMax[tile] = maxForceSeen;
+	}
+
+	// Two triangles per cell of the columns of a tile, colored by the forces normalized to [-1, 1]
+	// ---------------------------------------------------------------------------------------------
+	void triangulate(const unsigned int tile)
+	{
+		const unsigned int last = std::min(columns - 1, (tile + 1) * tileColumns);
+		unsigned int currentSamples [6];
 
-		for (unsigned int x = 0; x < xCount-1; ++x)
+		for (unsigned int x = tile * tileColumns; x < last; ++x)
 		{
-			for (unsigned int y = 0; y < yCount-1; ++y)
+			GLfloat * vertex = &vertices[x * (rows - 1) * 24];
+			for (unsigned int y = 0; y < rows-1; ++y)
 			{
-				currentSamples[0] = y + yCount * x;				// Bottom left
-				currentSamples[1] = (y + 1) + yCount * x;		// Top left
-				currentSamples[2] = (y + 1) + yCount * (x + 1);	// Top right
-				currentSamples[3] = y + yCount * x;				// Bottom left
-				currentSamples[4] = y + yCount * (x + 1);		// Bottom right
-				currentSamples[5] = (y + 1) + yCount * (x + 1);	// Top right
+				currentSamples[0] = y + rows * x;				// Bottom left
+				currentSamples[1] = (y + 1) + rows * x;			// Top left
+				currentSamples[2] = (y + 1) + rows * (x + 1);	// Top right
+				currentSamples[3] = y + rows * x;				// Bottom left
+				currentSamples[4] = y + rows * (x + 1);			// Bottom right
+				currentSamples[5] = (y + 1) + rows * (x + 1);	// Top right
 
 				for (auto cs : currentSamples)
 				{
-					vertices.push_back(positions[cs].x);	// xPos
-					vertices.push_back(positions[cs].y);	// yPos
-					vertices.push_back(1.0f + forces[cs]);	// red
-					vertices.push_back(1.0f - forces[cs]);	// green
-				}	
+					const GLfloat force = 2.0f * (slope * cappedForces[cs] + yIntercept);
+					*vertex++ = sampleX[cs];	// xPos
+					*vertex++ = sampleY[cs];	// yPos
+					*vertex++ = 1.0f + force;	// red
+					*vertex++ = 1.0f - force;	// green
+				}
+			}
+		}
+	}
+
+public:
+	// Updates until every tile has caught up with moving bodies, 1 = all of them in every update
+	// Larger values resample a rotating share of the tiles per update, the rest keeps the gradient of older bodies
+	void setStaleness(const unsigned int updates)
+	{
+		staleness = std::max(1u, updates);
+	}
+
+	// Counts the rebuilds of the vertices, copies of the same version draw the same gradient
+	unsigned int getVersion() const
+	{
+		return version;
+	}
+
+	// Calculates the force in each points and generates the vertices vector
+	// Only tiles behind the bodies are resampled, nothing at all while the bodies stand still
+	void update(const GLfloat scrWidth, const GLfloat scrHeight, GLuint xCount, GLuint yCount, const Bodies& bodies)
+	{
+		if (xCount == 0)
+			xCount = 2;
+		else if (xCount % 2 == 1)
+			++xCount;
+		if (yCount == 0)
+			yCount = 2;
+		else if (yCount % 2 == 1)
+			++yCount;
+
+		layout(scrWidth, scrHeight, xCount, yCount);
+		ThreadPool& pool = getThreadPool();
+		const unsigned int tiles = getTiles(columns);
+
+		// Jumps of more than a grid cell (new level, gradient shown again) resample everything at once,
+		// smaller steps only the next share of the rotation, so no tile falls more than staleness updates behind
+		const GLfloat moved = track(bodies);
+		const bool jump = moved > std::min(width / (columns - 1), height / (rows - 1));
+		const unsigned int share = jump ? tiles : (tiles + staleness - 1) / staleness;
+		refresh.clear();
+		for (unsigned int tile = 0; tile < tiles; ++tile)
+		{
+			const bool due = (tile + tiles - cursor) % tiles < share || tileVersion[tile] == unsampled;
+			if (due && tileVersion[tile] != bodyVersion)
+				refresh.push_back(tile);
+		}
+		cursor = (cursor + share) % tiles;
+		if (refresh.empty())
+			return;
+
+		// Get the absolute gravitional force for each point
+		pool.parallelFor((unsigned int)refresh.size(), [&](const unsigned int first, const unsigned int last, const unsigned int)
+		{
+			for (unsigned int i = first; i < last; ++i)
+				sample(refresh[i], bodies);
+		});
+
+		// Samples inside bodies depend on the samples before them, the last force outside is carried across tiles
+		std::fill(tileChanged.begin(), tileChanged.end(), 0);
+		for (const unsigned int tile : refresh)
+			tileChanged[tile] = 1;
+		GLfloat lastForce = 0.0f;
+		refresh.clear();
+		for (unsigned int tile = 0; tile < tiles; ++tile)
+		{
+			if (tileCarry[tile] != lastForce)
+			{
+				tileCarry[tile] = lastForce;
+				tileChanged[tile] = 1;
 			}
+			if (tileLast[tile] >= 0.0f)
+				lastForce = tileLast[tile];
+			if (tileChanged[tile])
+				refresh.push_back(tile);
 		}
+		pool.parallelFor((unsigned int)refresh.size(), [&](const unsigned int first, const unsigned int last, const unsigned int)
+		{
+			for (unsigned int i = first; i < last; ++i)
+				cap(refresh[i], tileCarry[refresh[i]]);
+		});
+
+		// Find normalizing function [minForce, maxForce] -> [-1, 1]: 2.0f * (slope * x + yIntercept)
+		const GLfloat minForce = *std::min_element(tileMin.begin(), tileMin.end());
+		const GLfloat newSlope = 1.0f / (*std::max_element(tileMax.begin(), tileMax.end()) - minForce);	// Interval of length 1 with slope = 1/(maxForce-minForce)
+		const GLfloat newYIntercept = -(newSlope * minForce) - 0.5f;										// Move interval to [-0.5, 0.5]
+
+		// Stale gradients keep their normalization until its colors drift visibly, then only resampled tiles are redone
+		const GLfloat drift = 2.0f * (std::abs(newSlope - slope) * maxForce + std::abs(newYIntercept - yIntercept));
+		const bool normalized = drift == 0.0f || (staleness > 1 && !jump && drift <= colorTolerance);
+		if (!normalized)
+		{
+			slope = newSlope;
+			yIntercept = newYIntercept;
+		}
+
+		// Generate the vertices vector, cells of a tile also use the first column of the next one
+		refresh.clear();
+		for (unsigned int tile = 0; tile < getTiles(columns - 1); ++tile)
+		{
+			if (!normalized || tileChanged[tile] || (tile + 1 < tiles && tileChanged[tile + 1]))
+				refresh.push_back(tile);
+		}
+		pool.parallelFor((unsigned int)refresh.size(), [&](const unsigned int first, const unsigned int last, const unsigned int)
+		{
+			for (unsigned int i = first; i < last; ++i)
+				triangulate(refresh[i]);
+		});
+		++version;
 	}
 
+#ifndef HEADLESS
 	// Draws the gradient
 	void draw(const Shader& shader) const
 	{
@@ -1031,6 +2026,7 @@ public:
 		glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
 	}
+#endif
 };
 
 #endif
\ No newline at end of file
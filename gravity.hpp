@@ -0,0 +1,324 @@
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+#include "glm/glm.hpp"	// Vectors
+
+#include <cmath>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GRAVITY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define GRAVITY_TARGET(isa)
+#else
+#define GRAVITY_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// Batched gravity summation: acceleration at one position caused by n sources given as arrays
+// The field kernels do the same for many positions at once, one position per lane and the sources
+// broadcast, which keeps the lanes full when there are only a handful of sources (see batch_env.hpp)
+// The kernels are picked once at startup by CPUID: AVX2 (8 lanes), SSE (4 lanes) or scalar
+//
+// Error bound against the scalar path (sqrt and divide per source):
+// The SIMD kernels use rsqrt (relative error <= 1.5 * 2^-12) refined by one Newton step, which leaves
+// a relative error <= 2^-22 (~2.4e-7) in 1/r. 1/r^3 is built from three of those factors plus two
+// roundings, so each source term is within 4e-6 (relative) of the scalar term and the sum within
+// 4e-6 of the sum of absolute terms. benchmark.cpp measures the worst case over random level layouts,
+// below 1e-6 of the absolute terms. Relative to the sum itself the error grows where the terms cancel.
+// ----------------------------------------------------------------------------------------------------
+namespace Gravity
+{
+	enum Isa { SCALAR, SSE, AVX2 };
+
+	typedef glm::vec2 (*Kernel)(const float * x, const float * y, const float * mass, const unsigned int n, const glm::vec2 position, const float g);
+	typedef void (*FieldKernel)(const float * x, const float * y, const float * mass, const unsigned int n, const float * px, const float * py, float * ax, float * ay, const unsigned int count, const float g);
+
+	// Reference implementation, also used for the remainder of the SIMD loops
+	// ------------------------------------------------------------------------
+	inline glm::vec2 sumScalar(const float * x, const float * y, const float * mass, const unsigned int n, const glm::vec2 position, const float g)
+	{
+		float sumX = 0.0f;
+		float sumY = 0.0f;
+
+		for (unsigned int i = 0; i < n; ++i)
+		{
+			const float dx = x[i] - position.x;
+			const float dy = y[i] - position.y;
+			const float rl = std::sqrt(dx * dx + dy * dy);
+			const float f = g * mass[i] / (rl * rl * rl);
+			sumX += f * dx;
+			sumY += f * dy;
+		}
+
+		return glm::vec2(sumX, sumY);
+	}
+
+	// Accelerations at count positions, one scalar sum per position
+	// ---------------------------------------------------------------
+	inline void fieldScalar(const float * x, const float * y, const float * mass, const unsigned int n, const float * px, const float * py, float * ax, float * ay, const unsigned int count, const float g)
+	{
+		for (unsigned int k = 0; k < count; ++k)
+		{
+			const glm::vec2 a = sumScalar(x, y, mass, n, glm::vec2(px[k], py[k]), g);
+			ax[k] = a.x;
+			ay[k] = a.y;
+		}
+	}
+
+#ifdef GRAVITY_X86
+	// 4 sources per iteration
+	// -----------------------
+	GRAVITY_TARGET("sse")
+	inline glm::vec2 sumSSE(const float * x, const float * y, const float * mass, const unsigned int n, const glm::vec2 position, const float g)
+	{
+		const __m128 px = _mm_set1_ps(position.x);
+		const __m128 py = _mm_set1_ps(position.y);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 threeHalves = _mm_set1_ps(1.5f);
+		__m128 sumX = _mm_setzero_ps();
+		__m128 sumY = _mm_setzero_ps();
+
+		unsigned int i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+			const __m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+			// 1/r with one Newton step: inv * (1.5 - 0.5 * r2 * inv^2)
+			__m128 inv = _mm_rsqrt_ps(r2);
+			inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(inv, inv))));
+
+			const __m128 f = _mm_mul_ps(_mm_loadu_ps(mass + i), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+			sumX = _mm_add_ps(sumX, _mm_mul_ps(f, dx));
+			sumY = _mm_add_ps(sumY, _mm_mul_ps(f, dy));
+		}
+
+		float lanesX[4], lanesY[4];
+		_mm_storeu_ps(lanesX, sumX);
+		_mm_storeu_ps(lanesY, sumY);
+		const glm::vec2 sum = g * glm::vec2(lanesX[0] + lanesX[1] + lanesX[2] + lanesX[3], lanesY[0] + lanesY[1] + lanesY[2] + lanesY[3]);
+
+		return sum + sumScalar(x + i, y + i, mass + i, n - i, position, g);
+	}
+
+	// 8 sources per iteration
+	// -----------------------
+	GRAVITY_TARGET("avx2,fma")
+	inline glm::vec2 sumAVX2(const float * x, const float * y, const float * mass, const unsigned int n, const glm::vec2 position, const float g)
+	{
+		const __m256 px = _mm256_set1_ps(position.x);
+		const __m256 py = _mm256_set1_ps(position.y);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 threeHalves = _mm256_set1_ps(1.5f);
+		__m256 sumX = _mm256_setzero_ps();
+		__m256 sumY = _mm256_setzero_ps();
+
+		unsigned int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+			const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+			const __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+
+			// 1/r with one Newton step: inv * (1.5 - 0.5 * r2 * inv^2)
+			__m256 inv = _mm256_rsqrt_ps(r2);
+			inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), threeHalves));
+
+			const __m256 f = _mm256_mul_ps(_mm256_loadu_ps(mass + i), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+			sumX = _mm256_fmadd_ps(f, dx, sumX);
+			sumY = _mm256_fmadd_ps(f, dy, sumY);
+		}
+
+		float lanesX[8], lanesY[8];
+		_mm256_storeu_ps(lanesX, sumX);
+		_mm256_storeu_ps(lanesY, sumY);
+		glm::vec2 sum(0.0f, 0.0f);
+		for (int lane = 0; lane < 8; ++lane)
+			sum += glm::vec2(lanesX[lane], lanesY[lane]);
+
+		return g * sum + sumScalar(x + i, y + i, mass + i, n - i, position, g);
+	}
+
+	// 4 positions per iteration
+	// -------------------------
+	GRAVITY_TARGET("sse")
+	inline void fieldSSE(const float * x, const float * y, const float * mass, const unsigned int n, const float * px, const float * py, float * ax, float * ay, const unsigned int count, const float g)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 threeHalves = _mm_set1_ps(1.5f);
+		const __m128 scale = _mm_set1_ps(g);
+
+		unsigned int k = 0;
+		for (; k + 4 <= count; k += 4)
+		{
+			const __m128 pX = _mm_loadu_ps(px + k);
+			const __m128 pY = _mm_loadu_ps(py + k);
+			__m128 sumX = _mm_setzero_ps();
+			__m128 sumY = _mm_setzero_ps();
+
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				const __m128 dx = _mm_sub_ps(_mm_set1_ps(x[i]), pX);
+				const __m128 dy = _mm_sub_ps(_mm_set1_ps(y[i]), pY);
+				const __m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+				__m128 inv = _mm_rsqrt_ps(r2);
+				inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(inv, inv))));
+
+				const __m128 f = _mm_mul_ps(_mm_set1_ps(mass[i]), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+				sumX = _mm_add_ps(sumX, _mm_mul_ps(f, dx));
+				sumY = _mm_add_ps(sumY, _mm_mul_ps(f, dy));
+			}
+
+			_mm_storeu_ps(ax + k, _mm_mul_ps(scale, sumX));
+			_mm_storeu_ps(ay + k, _mm_mul_ps(scale, sumY));
+		}
+
+		fieldScalar(x, y, mass, n, px + k, py + k, ax + k, ay + k, count - k, g);
+	}
+
+	// 8 positions per iteration
+	// -------------------------
+	GRAVITY_TARGET("avx2,fma")
+	inline void fieldAVX2(const float * x, const float * y, const float * mass, const unsigned int n, const float * px, const float * py, float * ax, float * ay, const unsigned int count, const float g)
+	{
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 threeHalves = _mm256_set1_ps(1.5f);
+		const __m256 scale = _mm256_set1_ps(g);
+
+		unsigned int k = 0;
+		for (; k + 8 <= count; k += 8)
+		{
+			const __m256 pX = _mm256_loadu_ps(px + k);
+			const __m256 pY = _mm256_loadu_ps(py + k);
+			__m256 sumX = _mm256_setzero_ps();
+			__m256 sumY = _mm256_setzero_ps();
+
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				const __m256 dx = _mm256_sub_ps(_mm256_set1_ps(x[i]), pX);
+				const __m256 dy = _mm256_sub_ps(_mm256_set1_ps(y[i]), pY);
+				const __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+
+				__m256 inv = _mm256_rsqrt_ps(r2);
+				inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), threeHalves));
+
+				const __m256 f = _mm256_mul_ps(_mm256_set1_ps(mass[i]), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+				sumX = _mm256_fmadd_ps(f, dx, sumX);
+				sumY = _mm256_fmadd_ps(f, dy, sumY);
+			}
+
+			_mm256_storeu_ps(ax + k, _mm256_mul_ps(scale, sumX));
+			_mm256_storeu_ps(ay + k, _mm256_mul_ps(scale, sumY));
+		}
+
+		fieldScalar(x, y, mass, n, px + k, py + k, ax + k, ay + k, count - k, g);
+	}
+#endif
+
+	// Finds the widest instruction set supported by CPU and OS
+	// --------------------------------------------------------
+	inline Isa detect()
+	{
+#if defined(GRAVITY_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		const bool sse = (info[3] & (1 << 25)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		const bool osAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+
+		if (osAVX && avx2 && fma)
+			return AVX2;
+		if (sse)
+			return SSE;
+#elif defined(GRAVITY_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return AVX2;
+		if (__builtin_cpu_supports("sse"))
+			return SSE;
+#endif
+		return SCALAR;
+	}
+
+	inline Kernel getKernel(const Isa isa)
+	{
+		switch (isa)
+		{
+#ifdef GRAVITY_X86
+		case AVX2:
+			return sumAVX2;
+		case SSE:
+			return sumSSE;
+#endif
+		default:
+			return sumScalar;
+		}
+	}
+
+	inline FieldKernel getFieldKernel(const Isa isa)
+	{
+		switch (isa)
+		{
+#ifdef GRAVITY_X86
+		case AVX2:
+			return fieldAVX2;
+		case SSE:
+			return fieldSSE;
+#endif
+		default:
+			return fieldScalar;
+		}
+	}
+
+	inline Isa isa = detect();
+	inline Kernel kernel = getKernel(isa);
+	inline FieldKernel fieldKernel = getFieldKernel(isa);
+
+	// Forces a kernel, falls back to the detected one if the CPU lacks the instruction set
+	// ------------------------------------------------------------------------------------
+	inline void select(const Isa newIsa)
+	{
+		if (newIsa <= detect())
+		{
+			isa = newIsa;
+			kernel = getKernel(isa);
+			fieldKernel = getFieldKernel(isa);
+		}
+	}
+
+	// Acceleration at position caused by the given sources
+	// -----------------------------------------------------
+	inline glm::vec2 sum(const float * x, const float * y, const float * mass, const unsigned int n, const glm::vec2 position, const float g)
+	{
+		return kernel(x, y, mass, n, position, g);
+	}
+
+	// Accelerations at count positions px, py caused by the given sources, written to ax, ay
+	// ---------------------------------------------------------------------------------------
+	inline void field(const float * x, const float * y, const float * mass, const unsigned int n, const float * px, const float * py, float * ax, float * ay, const unsigned int count, const float g)
+	{
+		fieldKernel(x, y, mass, n, px, py, ax, ay, count, g);
+	}
+
+	inline std::string getName()
+	{
+		switch (isa)
+		{
+		case AVX2:
+			return "AVX2";
+		case SSE:
+			return "SSE";
+		default:
+			return "scalar";
+		}
+	}
+}
+
+#endif
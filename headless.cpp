@@ -0,0 +1,172 @@
+// Plays a single launch through the game's simulation loop, without a window or GL context
+// Compile: g++ -std=c++1z headless.cpp -o headless -O3 -lstdc++fs -lpthread
+// Usage: headless [-a degrees] [-s speed] [-w ticks] [-b ticks] [-t ticks] [-p ticks] [level name]
+// -------------------------------------------------------------------------------------------------
+
+#ifndef HEADLESS
+#define HEADLESS		// Game objects without their draw code, see opengl.hpp
+#endif
+
+#include "glm/glm.hpp"
+#include "level.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#if __has_include(<filesystem>)
+#include <filesystem>
+#elif __has_include(<experimental/filesystem>)
+#include <experimental/filesystem>
+#endif
+namespace fs = std::experimental::filesystem;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+
+// Launch settings and limits of the flight
+// -----------------------------------------
+struct Flight
+{
+	float angle = 90.0f;				// Launch angle in degrees, as the ship starts in the game
+	float speed = 2.0f;					// Launch speed
+	unsigned int wait = 0;				// Game ticks the level runs before the launch
+	unsigned int boost = 0;				// Game ticks after the launch until the boost, 0 = no boost
+	unsigned int ticks = 6000;			// Game ticks after the launch until the flight is given up
+	unsigned int print = 0;				// Game ticks between printed positions, 0 = none
+};
+
+enum Outcome { WON, CRASHED, LOST, TIMEOUT };
+const char * outcomeNames[] = { "won", "crashed", "signal lost", "timeout" };
+
+
+int main(int argc, char * argv[])
+{
+	Flight flight;
+	std::string filePath;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (argument == "-a" && hasValue)
+			flight.angle = (float)std::atof(argv[++i]);
+		else if (argument == "-s" && hasValue)
+			flight.speed = (float)std::atof(argv[++i]);
+		else if (argument == "-w" && hasValue)
+			flight.wait = std::atoi(argv[++i]);
+		else if (argument == "-b" && hasValue)
+			flight.boost = std::atoi(argv[++i]);
+		else if (argument == "-t" && hasValue)
+			flight.ticks = std::atoi(argv[++i]);
+		else if (argument == "-p" && hasValue)
+			flight.print = std::atoi(argv[++i]);
+		else if (argument[0] == '-' || !filePath.empty())
+		{
+			std::cout << "Usage: headless [-a degrees] [-s speed] [-w ticks] [-b ticks] [-t ticks] [-p ticks] [level name]" << std::endl;
+			std::cout << "  -a  Launch angle in degrees (" << flight.angle << ")" << std::endl;
+			std::cout << "  -s  Launch speed, " << minLaunchSpeed << " to " << maxLaunchSpeed << " (" << flight.speed << ")" << std::endl;
+			std::cout << "  -w  Game ticks the level runs before the launch (" << flight.wait << ")" << std::endl;
+			std::cout << "  -b  Game ticks after the launch until the boost, 0 = no boost (" << flight.boost << ")" << std::endl;
+			std::cout << "  -t  Game ticks after the launch until the flight is given up (" << flight.ticks << ")" << std::endl;
+			std::cout << "  -p  Game ticks between printed positions, 0 = none (" << flight.print << ")" << std::endl;
+			return 2;
+		}
+		else
+			filePath = "levels/" + argument + ".lvl";
+	}
+
+	// Without a name the first level of the game
+	if (filePath.empty())
+	{
+		std::vector<std::string> files;
+		for (const auto & file : fs::directory_iterator("levels"))
+		{
+			const std::string path = file.path().string();
+			if (path.substr(path.length() - 4) == ".lvl")
+				files.push_back(path);
+		}
+		if (files.empty())
+		{
+			std::cout << "Error: No levels found" << std::endl;
+			return 2;
+		}
+		filePath = *std::min_element(files.begin(), files.end());
+	}
+
+	Level level(filePath);
+	if (!level.isValid())
+	{
+		std::cout << "Error: Invalid level " << filePath << std::endl;
+		return 2;
+	}
+	level.genPhysics();
+
+	SpaceShip player(level.getPlanets()[0]);
+	player.aim(glm::radians(flight.angle), flight.speed);
+	player.move(level.getBodies(), level.getIntegration());		// Onto the pad at the launch angle, as every step before the launch
+
+	const Integrator::Settings integration = level.getIntegration();
+	float time = 0;					// Game ticks since the level started
+	float launchTime = -1;			// Game ticks at the launch, negative while on the pad
+	float outside = 0;				// Game ticks spent outside the window
+	float nextPrint = 0;
+	unsigned long long steps = 0;
+	Outcome outcome = TIMEOUT;
+
+	// Same order as the simulation thread of the game: inputs between the steps, then bodies, then the ship
+	const Clock::time_point start = Clock::now();
+	while (launchTime < 0 || time - launchTime < flight.ticks)
+	{
+		if (launchTime < 0 && time >= flight.wait)
+		{
+			player.launchProgress();
+			launchTime = time;
+		}
+		else if (flight.boost > 0 && player.getLaunchState() == 2 && time - launchTime >= flight.boost)
+			player.launchProgress();
+
+		level.saveState();
+		player.saveState();
+		level.updatePhysics();
+		player.move(level.getBodies(), integration);
+		time += integration.timeStep;
+		++steps;
+
+		if (flight.print > 0 && launchTime >= 0 && time - launchTime >= nextPrint)
+		{
+			std::cout << time - launchTime << "\t" << player.getPosition().x << "\t" << player.getPosition().y << std::endl;
+			nextPrint += flight.print;
+		}
+
+		if (player.getLaunchState() == 4)
+		{
+			Planet& goal = level.getPlanets()[1];
+			outcome = glm::distance(player.getPosition(), goal.getPosition()) <= goal.getRadius() + collisionShip ? WON : CRASHED;
+			if (outcome == WON)
+				level.updateScore(200 - player.hasBoosted() * 100);
+			break;
+		}
+
+		if (loseSignal(player.getPosition(), integration.timeStep, outside))
+		{
+			outcome = LOST;
+			break;
+		}
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << "Level: " << level.getName() << std::endl;
+	std::cout << "Launch: " << flight.angle << " degrees, speed " << flight.speed;
+	if (flight.boost > 0)
+		std::cout << ", boost after " << flight.boost << " ticks" << (player.hasBoosted() ? "" : " (not reached)");
+	std::cout << std::endl;
+	std::cout << "Outcome: " << outcomeNames[outcome] << " after " << std::max(0.0f, time - launchTime) << " game ticks, score " << level.getScore() << std::endl;
+	std::cout << "Physics: " << steps << " steps in " << seconds * 1000.0 << " ms, " << steps / std::max(seconds, 1e-9) / 1e6 << " M steps/s" << std::endl;
+
+	// Zero only if the launch wins, so known solutions can be checked by scripts
+	return outcome == WON ? 0 : 1;
+}
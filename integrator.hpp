@@ -0,0 +1,283 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "glm/glm.hpp"	// Vectors
+#include "physics.hpp"	// Body store
+
+#include <string>
+#include <cmath>
+
+// Time integration schemes shared by level bodies and probes (space ship, boxes, trajectory)
+// Time is measured in ticks of the original 120 Hz game, so velocities keep their units
+//
+//               order  symplectic  force evaluations per step
+// Euler           1        yes        1   semi-implicit: v += a dt, x += v dt (the original scheme)
+// Leapfrog        2        yes        1   drift-kick-drift
+// Verlet          2        yes        1   kick-drift-kick, reuses the acceleration of the last step
+// Yoshida         4        yes        3   three Verlet steps with Yoshida's coefficients
+//
+// Probes can additionally use an adaptive Dormand-Prince 5(4) stepper (tolerance > 0). It takes 6 force
+// evaluations per step but picks the step size from an embedded error estimate: tiny sub-steps during
+// close encounters with black holes, steps of many ticks in empty space.
+// ----------------------------------------------------------------------------------------------------
+namespace Integrator
+{
+	enum Method { EULER, LEAPFROG, VERLET, YOSHIDA };
+
+	struct Settings
+	{
+		Method method = EULER;
+		float timeStep = 1.0f;	// Game ticks per physics step
+		float tolerance = 0.0f;	// Error per adaptive probe step in world units, 0 = fixed steps
+	};
+
+	const float minStep = 1.0e-3f;	// Adaptive steps below this are accepted regardless of the error
+	const float maxGrowth = 5.0f;	// Limits for the step size change after an adaptive step
+	const float maxShrink = 0.2f;
+
+	// Dormand-Prince coefficients, row s holds the weights of the stages before stage s + 1
+	// The last row is the 5th order solution, evaluated again as the first stage of the next step
+	const float dopriA[6][6] = {
+		{ 1.0f / 5.0f },
+		{ 3.0f / 40.0f, 9.0f / 40.0f },
+		{ 44.0f / 45.0f, -56.0f / 15.0f, 32.0f / 9.0f },
+		{ 19372.0f / 6561.0f, -25360.0f / 2187.0f, 64448.0f / 6561.0f, -212.0f / 729.0f },
+		{ 9017.0f / 3168.0f, -355.0f / 33.0f, 46732.0f / 5247.0f, 49.0f / 176.0f, -5103.0f / 18656.0f },
+		{ 35.0f / 384.0f, 0.0f, 500.0f / 1113.0f, 125.0f / 192.0f, -2187.0f / 6784.0f, 11.0f / 84.0f }
+	};
+	// Difference between the 5th and the embedded 4th order solution
+	const float dopriE[7] = { 71.0f / 57600.0f, 0.0f, -71.0f / 16695.0f, 71.0f / 1920.0f, -17253.0f / 339200.0f, 22.0f / 525.0f, -1.0f / 40.0f };
+
+	// Yoshida's 4th order coefficients
+	const float yoshidaW1 = 1.0f / (2.0f - std::cbrt(2.0f));
+	const float yoshidaW0 = -std::cbrt(2.0f) * yoshidaW1;
+	const float yoshidaDrift[3] = { yoshidaW1, yoshidaW0, yoshidaW1 };
+	const float yoshidaKick[4] = { 0.5f * yoshidaW1, 0.5f * (yoshidaW0 + yoshidaW1), 0.5f * (yoshidaW0 + yoshidaW1), 0.5f * yoshidaW1 };
+
+	// Parses a method name from a level file, returns false if unknown
+	// -----------------------------------------------------------------
+	inline bool parse(const std::string name, Method& method)
+	{
+		if (name == "euler")
+			method = EULER;
+		else if (name == "leapfrog")
+			method = LEAPFROG;
+		else if (name == "verlet")
+			method = VERLET;
+		else if (name == "yoshida")
+			method = YOSHIDA;
+		else
+			return false;
+		return true;
+	}
+
+	inline std::string getName(const Method method)
+	{
+		switch (method)
+		{
+		case LEAPFROG:
+			return "leapfrog";
+		case VERLET:
+			return "verlet";
+		case YOSHIDA:
+			return "yoshida";
+		default:
+			return "euler";
+		}
+	}
+
+	inline unsigned int getEvaluations(const Method method)
+	{
+		return method == YOSHIDA ? 3 : 1;
+	}
+
+	// Whether step() starts from the acceleration left by the last step
+	inline bool reusesAcceleration(const Method method)
+	{
+		return method == VERLET || method == YOSHIDA;
+	}
+
+	// Whether advance() starts from the acceleration left by the last step
+	inline bool reusesAcceleration(const Settings& settings)
+	{
+		return settings.tolerance > 0.0f || reusesAcceleration(settings.method);
+	}
+
+	// Advances a single probe by dt through the field accelerationAt(position)
+	// Verlet and Yoshida expect acceleration to hold the value at the initial position,
+	// every method leaves the last evaluated acceleration in it
+	// ----------------------------------------------------------------------------------
+	template <typename Field>
+	void step(const Method method, glm::vec2& position, glm::vec2& velocity, glm::vec2& acceleration, const float dt, const Field& accelerationAt)
+	{
+		switch (method)
+		{
+		case LEAPFROG:
+			position += 0.5f * dt * velocity;
+			acceleration = accelerationAt(position);
+			velocity += dt * acceleration;
+			position += 0.5f * dt * velocity;
+			break;
+
+		case VERLET:
+			velocity += 0.5f * dt * acceleration;
+			position += dt * velocity;
+			acceleration = accelerationAt(position);
+			velocity += 0.5f * dt * acceleration;
+			break;
+
+		case YOSHIDA:
+			for (int i = 0; i < 3; ++i)
+			{
+				velocity += yoshidaKick[i] * dt * acceleration;
+				position += yoshidaDrift[i] * dt * velocity;
+				acceleration = accelerationAt(position);
+			}
+			velocity += yoshidaKick[3] * dt * acceleration;
+			break;
+
+		default:
+			acceleration = accelerationAt(position);
+			velocity += dt * acceleration;
+			position += dt * velocity;
+		}
+	}
+
+	// One accepted Dormand-Prince step of at most maxStep ticks, returns the step taken
+	// stepSize carries the proposed step between calls, 0 lets the first step start from the acceleration.
+	// Expects acceleration to hold the value at the initial position and leaves the one at the end in it.
+	// The error is the larger of the position and velocity error, so tolerance is in world units per tick.
+	// ----------------------------------------------------------------------------------------------------
+	template <typename Field>
+	float adaptiveStep(glm::vec2& position, glm::vec2& velocity, glm::vec2& acceleration, float& stepSize, const float maxStep, const float tolerance, const Field& accelerationAt)
+	{
+		// Initial guess: the distance neglected by ignoring the acceleration equals the tolerance
+		if (stepSize <= 0.0f)
+		{
+			const float a = glm::length(acceleration);
+			stepSize = a > 0.0f ? std::sqrt(2.0f * tolerance / a) : maxStep;
+		}
+
+		glm::vec2 kx[7], kv[7];
+		kx[0] = velocity;
+		kv[0] = acceleration;
+
+		while (true)
+		{
+			const bool truncated = stepSize >= maxStep;
+			const float h = std::max(std::min(stepSize, maxStep), std::min(minStep, maxStep));
+
+			glm::vec2 x, v;
+			for (int s = 1; s < 7; ++s)
+			{
+				x = position;
+				v = velocity;
+				for (int j = 0; j < s; ++j)
+				{
+					x += h * dopriA[s - 1][j] * kx[j];
+					v += h * dopriA[s - 1][j] * kv[j];
+				}
+				kx[s] = v;
+				kv[s] = accelerationAt(x);
+			}
+
+			glm::vec2 errorX(0.0f, 0.0f), errorV(0.0f, 0.0f);
+			for (int j = 0; j < 7; ++j)
+			{
+				errorX += h * dopriE[j] * kx[j];
+				errorV += h * dopriE[j] * kv[j];
+			}
+			const float error = std::max(glm::length(errorX), glm::length(errorV)) / tolerance;
+
+			// Standard controller with safety factor 0.9 and a 5th order error
+			const float scale = error > 0.0f ? 0.9f * std::pow(error, -0.2f) : maxGrowth;
+			const float proposal = h * std::min(maxGrowth, std::max(maxShrink, scale));
+
+			if (error <= 1.0f || h <= minStep)
+			{
+				position = x;
+				velocity = v;
+				acceleration = kv[6];
+				// A step cut short by maxStep says nothing about the step size that would have worked
+				stepSize = truncated ? std::max(stepSize, proposal) : proposal;
+				return h;
+			}
+
+			stepSize = proposal;
+		}
+	}
+
+	// Advances a probe by dt with adaptive sub-steps
+	// -----------------------------------------------
+	template <typename Field>
+	void adaptiveAdvance(glm::vec2& position, glm::vec2& velocity, glm::vec2& acceleration, float& stepSize, const float dt, const float tolerance, const Field& accelerationAt)
+	{
+		float remaining = dt;
+		while (remaining > minStep * 0.5f)
+			remaining -= adaptiveStep(position, velocity, acceleration, stepSize, remaining, tolerance, accelerationAt);
+	}
+
+	// Advances a probe by one physics step of the settings, adaptive if a tolerance is set
+	// -------------------------------------------------------------------------------------
+	template <typename Field>
+	void advance(const Settings& settings, glm::vec2& position, glm::vec2& velocity, glm::vec2& acceleration, float& stepSize, const Field& accelerationAt)
+	{
+		if (settings.tolerance > 0.0f)
+			adaptiveAdvance(position, velocity, acceleration, stepSize, settings.timeStep, settings.tolerance, accelerationAt);
+		else
+			step(settings.method, position, velocity, acceleration, settings.timeStep, accelerationAt);
+	}
+
+	// Cubic Hermite interpolation between two states h ticks apart, s in [0, 1]
+	// --------------------------------------------------------------------------
+	inline glm::vec2 interpolate(const glm::vec2 position0, const glm::vec2 velocity0, const glm::vec2 position1, const glm::vec2 velocity1, const float h, const float s)
+	{
+		const float s2 = s * s;
+		const float s3 = s2 * s;
+		return (2.0f * s3 - 3.0f * s2 + 1.0f) * position0 + (s3 - 2.0f * s2 + s) * h * velocity0
+			+ (3.0f * s2 - 2.0f * s3) * position1 + (s3 - s2) * h * velocity1;
+	}
+
+	// Advances the entries [first, last) of a structure-of-arrays store by dt, the level's body store or
+	// the probes of a batch (see batch_env.hpp), both provide kick() and drift() over a range
+	// accelerate() has to fill ax and ay from the current positions, Verlet and Yoshida
+	// expect them to be up to date on entry and leave them up to date on exit
+	// ---------------------------------------------------------------------------------------------------
+	template <typename Store, typename Accelerate>
+	void step(const Method method, Store& bodies, const unsigned int first, const unsigned int last, const float dt, const Accelerate& accelerate)
+	{
+		switch (method)
+		{
+		case LEAPFROG:
+			bodies.drift(first, last, 0.5f * dt);
+			accelerate();
+			bodies.kick(first, last, dt);
+			bodies.drift(first, last, 0.5f * dt);
+			break;
+
+		case VERLET:
+			bodies.kick(first, last, 0.5f * dt);
+			bodies.drift(first, last, dt);
+			accelerate();
+			bodies.kick(first, last, 0.5f * dt);
+			break;
+
+		case YOSHIDA:
+			for (int i = 0; i < 3; ++i)
+			{
+				bodies.kick(first, last, yoshidaKick[i] * dt);
+				bodies.drift(first, last, yoshidaDrift[i] * dt);
+				accelerate();
+			}
+			bodies.kick(first, last, yoshidaKick[3] * dt);
+			break;
+
+		default:
+			accelerate();
+			bodies.kick(first, last, dt);
+			bodies.drift(first, last, dt);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include "glm/glm.hpp"	// Vectors
+
+#include <cmath>
+#include <limits>
+
+// Closed-form two-body orbits
+// An orbit is described by its elements instead of being integrated, the state at any time is found by
+// solving Kepler's equation: M = E - e sin(E) on ellipses, M = e sinh(F) - F on hyperbolas. This costs
+// the same for any time, doesn't drift and lets predictions look arbitrarily far ahead. Angles and times
+// are doubles, the mean anomaly grows without bound and floats would lose the phase after a few orbits.
+// -------------------------------------------------------------------------------------------------------
+namespace Kepler
+{
+	const double twoPi = 6.283185307179586;
+	const double never = std::numeric_limits<double>::infinity();
+	const int maxIterations = 20;			// Newton iterations for Kepler's equation
+	const double convergence = 1.0e-10;
+	const double parabolic = 1.0e-6;		// Orbits closer to e = 1 are rejected, both equations degenerate there
+
+	struct Orbit
+	{
+		double mu = 0;				// G times the central mass
+		double a = 0;				// Semi-major axis, negative on hyperbolas
+		double e = 0;				// Eccentricity, < 1 bound, > 1 escaping
+		double periapsis = 0;		// Angle of the periapsis direction
+		double meanMotion = 0;		// Radians per game tick
+		double meanAnomaly = 0;		// At time 0
+		double direction = 1;		// 1 = counterclockwise, -1 = clockwise
+	};
+
+	// Elements of the orbit through a relative position and velocity around a central mass
+	// Returns false for degenerate orbits (radial or close to parabolic)
+	// -------------------------------------------------------------------------------------
+	inline bool fromState(const glm::vec2 position, const glm::vec2 velocity, const double mu, Orbit& orbit)
+	{
+		const double rx = position.x, ry = position.y, vx = velocity.x, vy = velocity.y;
+		const double r = std::sqrt(rx * rx + ry * ry);
+		const double v2 = vx * vx + vy * vy;
+		const double rv = rx * vx + ry * vy;
+		const double h = rx * vy - ry * vx;		// Specific angular momentum, the sign gives the direction
+
+		if (h == 0 || r == 0)
+			return false;
+
+		// Eccentricity vector, pointing to the periapsis
+		const double ex = ((v2 - mu / r) * rx - rv * vx) / mu;
+		const double ey = ((v2 - mu / r) * ry - rv * vy) / mu;
+		const double e = std::sqrt(ex * ex + ey * ey);
+		if (std::abs(e - 1) < parabolic)
+			return false;
+
+		orbit.mu = mu;
+		orbit.a = 1 / (2 / r - v2 / mu);
+		orbit.e = e;
+		orbit.direction = h > 0 ? 1 : -1;
+		// Circular orbits have no periapsis, anomalies are measured from the x axis then
+		orbit.periapsis = e > 1.0e-7 ? std::atan2(ey, ex) : 0;
+		orbit.meanMotion = std::sqrt(mu / std::abs(orbit.a * orbit.a * orbit.a));
+
+		const double trueAnomaly = std::remainder(orbit.direction * (std::atan2(ry, rx) - orbit.periapsis), twoPi);
+		if (e < 1)
+		{
+			const double E = std::atan2(std::sqrt(1 - e * e) * std::sin(trueAnomaly), e + std::cos(trueAnomaly));
+			orbit.meanAnomaly = E - e * std::sin(E);
+		}
+		else
+		{
+			const double F = std::asinh(std::sqrt(e * e - 1) * std::sin(trueAnomaly) / (1 + e * std::cos(trueAnomaly)));
+			orbit.meanAnomaly = e * std::sinh(F) - F;
+		}
+		return true;
+	}
+
+	// Eccentric (ellipse) or hyperbolic anomaly for a mean anomaly
+	// -------------------------------------------------------------
+	inline double solve(const double e, const double M)
+	{
+		// Newton's method from Danby's starting values, converges in a few steps for any e
+		if (e < 1)
+		{
+			double E = M + 0.85 * e * (std::sin(M) < 0 ? -1 : 1);
+			for (int i = 0; i < maxIterations; ++i)
+			{
+				const double delta = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
+				E -= delta;
+				if (std::abs(delta) < convergence)
+					break;
+			}
+			return E;
+		}
+
+		double F = std::asinh(M / e);
+		for (int i = 0; i < maxIterations; ++i)
+		{
+			const double delta = (e * std::sinh(F) - F - M) / (e * std::cosh(F) - 1);
+			F -= delta;
+			if (std::abs(delta) < convergence)
+				break;
+		}
+		return F;
+	}
+
+	// Relative position and velocity on the orbit at a time in game ticks
+	// --------------------------------------------------------------------
+	inline void state(const Orbit& orbit, const double time, glm::vec2& position, glm::vec2& velocity)
+	{
+		const double e = orbit.e;
+		const double a = std::abs(orbit.a);
+		double px, py, qx, qy;
+
+		// In the frame of the periapsis
+		if (e < 1)
+		{
+			const double E = solve(e, std::remainder(orbit.meanAnomaly + orbit.meanMotion * time, twoPi));
+			const double cosE = std::cos(E), sinE = std::sin(E);
+			const double b = std::sqrt(1 - e * e);
+			const double speed = std::sqrt(orbit.mu * a) / (a * (1 - e * cosE));
+			px = a * (cosE - e);
+			py = a * b * sinE;
+			qx = -speed * sinE;
+			qy = speed * b * cosE;
+		}
+		else
+		{
+			const double F = solve(e, orbit.meanAnomaly + orbit.meanMotion * time);
+			const double coshF = std::cosh(F), sinhF = std::sinh(F);
+			const double b = std::sqrt(e * e - 1);
+			const double speed = std::sqrt(orbit.mu * a) / (a * (e * coshF - 1));
+			px = a * (e - coshF);
+			py = a * b * sinhF;
+			qx = -speed * sinhF;
+			qy = speed * b * coshF;
+		}
+
+		// Mirrored for clockwise orbits, then rotated to the periapsis direction
+		py *= orbit.direction;
+		qy *= orbit.direction;
+		const double c = std::cos(orbit.periapsis), s = std::sin(orbit.periapsis);
+		position = glm::vec2((float)(c * px - s * py), (float)(s * px + c * py));
+		velocity = glm::vec2((float)(c * qx - s * qy), (float)(s * qx + c * qy));
+	}
+
+	// Time from time 0 until the distance to the center first crosses radius, never if it doesn't
+	// outward: crossing while moving away (leaving a sphere), else while approaching (hitting a surface)
+	// ----------------------------------------------------------------------------------------------------
+	inline double timeToRadius(const Orbit& orbit, const double radius, const bool outward)
+	{
+		const double e = orbit.e;
+		const double a = std::abs(orbit.a);
+		double M;
+
+		if (e < 1)
+		{
+			// r = a (1 - e cos(E)), moving away for E in (0, pi)
+			const double cosE = (1 - radius / a) / e;
+			if (e == 0 || cosE < -1 || cosE > 1)
+				return never;
+			const double E = std::acos(cosE) * (outward ? 1 : -1);
+			M = E - e * std::sin(E);
+			// Next time the mean anomaly passes M, one period is twoPi
+			const double ahead = M - orbit.meanAnomaly;
+			return (ahead - twoPi * std::floor(ahead / twoPi)) / orbit.meanMotion;
+		}
+
+		// r = a (e cosh(F) - 1), moving away for F > 0, each radius is passed at most twice
+		const double coshF = (radius / a + 1) / e;
+		if (coshF < 1)
+			return never;
+		const double F = std::acosh(coshF) * (outward ? 1 : -1);
+		M = e * std::sinh(F) - F;
+		return M >= orbit.meanAnomaly ? (M - orbit.meanAnomaly) / orbit.meanMotion : never;
+	}
+}
+
+#endif
@@ -1,14 +1,21 @@
 #ifndef LEVEL_H
 #define LEVEL_H
 
-#include <glad/glad.h>
+#include "opengl.hpp"
 
 #include "game_objects.hpp"
+#include "physics.hpp"
+#include "integrator.hpp"
+#include "ephemeris.hpp"
 
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
+
+const float ephemerisTicks = 2048.0f;				// Game ticks the level bodies are precomputed ahead
+const unsigned int ephemerisMaxFloats = 1u << 22;	// Memory limit of the ephemeris (16 MB), larger levels predict with frozen bodies
 
 class Level
 {
@@ -21,13 +28,28 @@ private:
 	std::vector<Planet> planets;
 	std::vector<Moon> moons;
 	std::vector<BlackHole> blackHoles;
-	std::vector<PointMass*> physicsCore;
+	Bodies bodies;						// Physics core, all of the above in one contiguous store
+	unsigned int firstMoon = 0;			// Moons follow their planet on Kepler orbits
+	bool staticBodies = true;			// Nothing moves, e.g. predictions never go stale
+	unsigned int stepCount = 0;			// Physics steps since genPhysics()
+	GLfloat openingAngle = 0.0f;		// Barnes-Hut opening angle, 0 = direct summation
+	bool nBody = false;					// Mutual gravitation between all bodies
+	Integrator::Settings integration;
+	std::shared_ptr<Ephemeris> ephemeris;	// Only used by the simulation, copies of the level (snapshots) share it
 	std::vector<Star> stars;
 	std::vector<Box> boxes;
 
+	// File name without directories and extension, e.g. levels/1_slide1.lvl gives 1_slide1
+	static std::string stem(const std::string& filePath)
+	{
+		const size_t first = filePath.find_last_of("/\\") + 1;
+		const size_t dot = filePath.find_last_of('.');
+		return filePath.substr(first, dot != std::string::npos && dot > first ? dot - first : std::string::npos);
+	}
+
 public:
 	Level(const std::string filePath)
-		: name(filePath.substr(7, filePath.length() - 11))
+		: name(stem(filePath))
 	{
 		std::ifstream levelFile;
 
@@ -79,7 +101,8 @@ public:
 					std::cout << "Error: Planet index out of range" << std::endl;
 					continue;
 				}
-				Moon temp(mass, radius, r, g, b, planets[planetIndex], distance, glm::radians(angle), clockwise);
+				// Planets follow the point masses in the body store, see genPhysics()
+				Moon temp(mass, radius, r, g, b, planets[planetIndex], (unsigned int)pointMasses.size() + planetIndex, distance, glm::radians(angle), clockwise);
 				moons.push_back(temp);
 			}
 
@@ -92,6 +115,36 @@ public:
 				blackHoles.push_back(temp);
 			}
 
+			// Process optional settings
+			std::string setting;
+			while (levelFile >> setting)
+			{
+				if (setting == "barnesHut")
+					levelFile >> openingAngle;
+				else if (setting == "nBody")
+					levelFile >> nBody;
+				else if (setting == "integrator")
+				{
+					std::string method;
+					levelFile >> method;
+					if (!Integrator::parse(method, integration.method))
+						std::cout << "Error: Unknown integrator " << method << std::endl;
+				}
+				else if (setting == "timeStep")
+					levelFile >> integration.timeStep;
+				else if (setting == "adaptive")
+					levelFile >> integration.tolerance;
+				else
+				{
+					std::cout << "Error: Unknown level setting " << setting << std::endl;
+					break;
+				}
+			}
+
+			const unsigned int nBodies = (unsigned int)(pointMasses.size() + planets.size() + moons.size() + blackHoles.size());
+			if (openingAngle > 0.0f && nBodies < barnesHutMinBodies(openingAngle))
+				std::cout << "Notice: barnesHut " << openingAngle << " ignored, direct summation is faster below " << barnesHutMinBodies(openingAngle) << " bodies" << std::endl;
+
 			/*
 			std::cout << "Point masses generated: " << pointMasses.size() << std::endl;
 			std::cout << "Planets generated: " << planets.size() << std::endl;
@@ -105,43 +158,189 @@ public:
 		else
 		{
 			std::cout << "Could not open " << filePath << std::endl;
+			valid = false;
 		}
 
 	}
 
 	
-	// Generate physics core
+	// Copies and moves point their objects at their own body store, never at the one of the source
+	// ---------------------------------------------------------------------------------------------
+	Level(const Level& other)
+		: name(other.name), valid(other.valid), score(other.score), pointMasses(other.pointMasses), planets(other.planets), moons(other.moons),
+		blackHoles(other.blackHoles), bodies(other.bodies), firstMoon(other.firstMoon), staticBodies(other.staticBodies), stepCount(other.stepCount),
+		openingAngle(other.openingAngle), nBody(other.nBody), integration(other.integration), ephemeris(other.ephemeris), stars(other.stars), boxes(other.boxes)
+	{
+		rebind();
+	}
+
+	Level(Level&& other)
+		: name(std::move(other.name)), valid(other.valid), score(other.score), pointMasses(std::move(other.pointMasses)), planets(std::move(other.planets)),
+		moons(std::move(other.moons)), blackHoles(std::move(other.blackHoles)), bodies(std::move(other.bodies)), firstMoon(other.firstMoon),
+		staticBodies(other.staticBodies), stepCount(other.stepCount), openingAngle(other.openingAngle), nBody(other.nBody), integration(other.integration),
+		ephemeris(std::move(other.ephemeris)), stars(std::move(other.stars)), boxes(std::move(other.boxes))
+	{
+		rebind();
+	}
+
+	Level& operator=(Level&& other)
+	{
+		name = std::move(other.name);
+		valid = other.valid;
+		score = other.score;
+		pointMasses = std::move(other.pointMasses);
+		planets = std::move(other.planets);
+		moons = std::move(other.moons);
+		blackHoles = std::move(other.blackHoles);
+		bodies = std::move(other.bodies);
+		firstMoon = other.firstMoon;
+		staticBodies = other.staticBodies;
+		stepCount = other.stepCount;
+		openingAngle = other.openingAngle;
+		nBody = other.nBody;
+		integration = other.integration;
+		ephemeris = std::move(other.ephemeris);
+		stars = std::move(other.stars);
+		boxes = std::move(other.boxes);
+		rebind();
+		return *this;
+	}
+
+	// Generate physics core, binding all objects to the body store
 	void genPhysics()
 	{
+		bodies.clear();
+
 		// PointMasses
 		for (auto & pm : pointMasses)
-			physicsCore.push_back(dynamic_cast<PointMass*>(&pm));
+			pm.bind(bodies);
 		// Planets
 		for (auto & p : planets)
-			physicsCore.push_back(dynamic_cast<PointMass*>(&p));
+			p.bind(bodies);
 		// Moons
+		firstMoon = bodies.size();
 		for (auto & m : moons)
-			physicsCore.push_back(dynamic_cast<PointMass*>(&m));
+			m.bind(bodies);
 		// Black holes
 		for (auto & bh : blackHoles)
-			physicsCore.push_back(dynamic_cast<PointMass*>(&bh));
+			bh.bind(bodies);
+		bodies.setOpeningAngle(openingAngle);
+		stepCount = 0;
+		if (nBody)
+			bodies.mutualAcceleration();
+
+		// Without mutual gravitation only moons and bodies with a velocity move, black holes stay put
+		staticBodies = !nBody && moons.empty();
+		for (unsigned int i = 0; i < firstMoon; ++i)
+		{
+			if (bodies.vx[i] != 0.0f || bodies.vy[i] != 0.0f)
+				staticBodies = false;
+		}
+
+		// Precompute the moving bodies, levels where nothing moves don't need an ephemeris
+		const unsigned int steps = (unsigned int)ceil(ephemerisTicks / integration.timeStep) + 1;
+		ephemeris.reset();
+		if (!staticBodies && steps * bodies.size() * 4 <= ephemerisMaxFloats)
+		{
+			ephemeris = std::make_shared<Ephemeris>();
+			ephemeris->reset(bodies, steps, integration.timeStep, [this](Bodies& store, const unsigned int step) { stepBodies(store, step); });
+		}
 
 		planets[0].setTerraforming(100);
 		planets[1].setTerraforming(100);
 	}
 
 
+	// Moves a store with the layout of the body store to the given physics step
+	void stepBodies(Bodies& store, const unsigned int step)
+	{
+		if (nBody)
+		{
+			// All bodies attract each other, including black holes
+			Integrator::step(integration.method, store, 0, store.size(), integration.timeStep, [&] { store.mutualAcceleration(); });
+		}
+		else
+		{
+			// No forces act on planets and point masses, moons are placed on their orbit around the moved planet
+			store.drift(0, firstMoon, integration.timeStep);
+			for (auto & moon : moons)
+				moon.propagate(store, (double)step * integration.timeStep);
+		}
+	}
+
+	// Points all objects at this level's own body store, needed after copying a level
+	void rebind()
+	{
+		for (auto & pm : pointMasses)
+			pm.view(bodies);
+		for (auto & p : planets)
+			p.view(bodies);
+		for (auto & m : moons)
+			m.view(bodies);
+		for (auto & bh : blackHoles)
+			bh.view(bodies);
+		for (auto & box : boxes)
+			box.setBodies(bodies);
+	}
+
+	// Takes over what changes during play from the level this one is a copy of: bodies, terraforming, boxes, score
+	// Reuses the buffers of this copy, so publishing a running level doesn't allocate once the boxes have room.
+	// Returns false without copying anything if the source has another layout, e.g. a different level.
+	// -------------------------------------------------------------------------------------------------------------
+	bool copyState(const Level& source)
+	{
+		if (source.bodies.size() != bodies.size() || source.planets.size() != planets.size() || source.moons.size() != moons.size() || source.name != name)
+			return false;
+
+		bodies.copyState(source.bodies);
+		for (unsigned int i = 0; i < planets.size(); ++i)
+			planets[i].copyState(source.planets[i]);
+		for (unsigned int i = 0; i < moons.size(); ++i)
+			moons[i].copyState(source.moons[i]);
+		boxes.clear();
+		for (const auto & box : source.boxes)
+			boxes.push_back(box);
+		score = source.score;
+		rebind();
+		return true;
+	}
+
+	// Keep the current state for rendering between this and the next physics step
+	void saveState()
+	{
+		bodies.saveState();
+		for (auto & box : boxes)
+			box.saveState();
+	}
+
 	// Move objects in level
 	void updatePhysics()
 	{
-		for (auto & pm : pointMasses)
-			pm.move();
 		for (auto & planet : planets)
-			planet.move();
+			planet.terraform(integration.timeStep);
 		for (auto & moon : moons)
-			moon.move();
+			moon.terraform(integration.timeStep);
+
+		if (ephemeris)
+		{
+			// The bodies were integrated ahead, the next precomputed step becomes the current state
+			ephemeris->advance([this](Bodies& store, const unsigned int step) { stepBodies(store, step); });
+			ephemeris->read(bodies);
+		}
+		else
+			stepBodies(bodies, stepCount + 1);
+		++stepCount;
+		bodies.buildTree();
+
 		for (auto & box : boxes)
+		{
+			if (box.hasLanded())
+				continue;
+
 			box.move();
+			if (box.hasLanded())
+				getBody(box.getLandingSite()).setTerraforming(1);
+		}
 	}
 
 	void updateScore(const int value)
@@ -179,9 +378,46 @@ public:
 	{
 		return blackHoles;
 	}
-	std::vector<PointMass*>& getPhysics()
+	const Integrator::Settings& getIntegration() const
+	{
+		return integration;
+	}
+	Bodies& getBodies()
+	{
+		return bodies;
+	}
+	// Changes whenever the bodies move, stays the same on levels where nothing moves
+	unsigned int getStateVersion() const
+	{
+		return staticBodies ? 0 : stepCount;
+	}
+	unsigned int getStepCount() const
+	{
+		return stepCount;
+	}
+	// Future states of the bodies, nullptr if they don't move or are too many to store
+	const Ephemeris * getEphemeris() const
+	{
+		return ephemeris.get();
+	}
+	// Body store index of the planet the player has to land on
+	unsigned int getTargetBody() const
+	{
+		return (unsigned int)pointMasses.size() + 1;
+	}
+	// Object behind a body store index, in the order of genPhysics()
+	PointMass& getBody(unsigned int index)
 	{
-		return physicsCore;
+		if (index < pointMasses.size())
+			return pointMasses[index];
+		index -= pointMasses.size();
+		if (index < planets.size())
+			return planets[index];
+		index -= planets.size();
+		if (index < moons.size())
+			return moons[index];
+		index -= moons.size();
+		return blackHoles[index];
 	}
 	std::vector<Box>& getBoxes()
 	{
@@ -0,0 +1,201 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include "thread_pool.hpp"
+#include "gravity.hpp"		// Instruction set dispatch
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Exact mutual gravitation between all bodies (direct sum, O(n^2))
+// Bodies are split into tiles that fit into L1 cache. Every pair of tiles is evaluated once and
+// applies equal and opposite accelerations (Newton's third law), halving the work. Tile pairs are
+// distributed over the thread pool, each thread accumulating into its own buffers to avoid races.
+// -------------------------------------------------------------------------------------------------
+namespace NBody
+{
+	const unsigned int tileSize = 128;
+	const unsigned int minParallelBodies = 256;	// Below this the threads cost more than they save
+
+	// Per-worker acceleration buffers and the tile pairs, reused between ticks
+	// thread_local, so the simulation and the trajectory worker can both run mutual gravitation
+	inline thread_local std::vector<std::vector<float>> bufferX, bufferY;
+	inline thread_local std::vector<unsigned int> bufferPairI, bufferPairJ;
+
+	// Interactions between tile [i0, i1) and tile [j0, j1), or within one tile if i0 == j0
+	// ------------------------------------------------------------------------------------
+	inline void tilePair(const float * x, const float * y, const float * m, float * ax, float * ay, const unsigned int i0, const unsigned int i1, const unsigned int j0, const unsigned int j1)
+	{
+		const bool sameTile = i0 == j0;
+
+		for (unsigned int i = i0; i < i1; ++i)
+		{
+			const float xi = x[i];
+			const float yi = y[i];
+			const float mi = m[i];
+			float sumX = 0.0f;
+			float sumY = 0.0f;
+
+			for (unsigned int j = sameTile ? i + 1 : j0; j < j1; ++j)
+			{
+				const float dx = x[j] - xi;
+				const float dy = y[j] - yi;
+				const float r2 = dx * dx + dy * dy;
+				const float inv3 = 1.0f / (r2 * std::sqrt(r2));
+				sumX += m[j] * inv3 * dx;
+				sumY += m[j] * inv3 * dy;
+				ax[j] -= mi * inv3 * dx;
+				ay[j] -= mi * inv3 * dy;
+			}
+
+			ax[i] += sumX;
+			ay[i] += sumY;
+		}
+	}
+
+#ifdef GRAVITY_X86
+	// Same as tilePair with 8 partners per iteration, 1/r from rsqrt plus one Newton step (see gravity.hpp)
+	// ------------------------------------------------------------------------------------------------------
+	GRAVITY_TARGET("avx2,fma")
+	inline void tilePairAVX2(const float * x, const float * y, const float * m, float * ax, float * ay, const unsigned int i0, const unsigned int i1, const unsigned int j0, const unsigned int j1)
+	{
+		const bool sameTile = i0 == j0;
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 threeHalves = _mm256_set1_ps(1.5f);
+
+		for (unsigned int i = i0; i < i1; ++i)
+		{
+			const __m256 xi = _mm256_set1_ps(x[i]);
+			const __m256 yi = _mm256_set1_ps(y[i]);
+			const __m256 mi = _mm256_set1_ps(m[i]);
+			__m256 sumX = _mm256_setzero_ps();
+			__m256 sumY = _mm256_setzero_ps();
+
+			unsigned int j = sameTile ? i + 1 : j0;
+			for (; j + 8 <= j1; j += 8)
+			{
+				const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+				const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+				const __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+
+				__m256 inv = _mm256_rsqrt_ps(r2);
+				inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), threeHalves));
+				const __m256 inv3 = _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv));
+
+				const __m256 fj = _mm256_mul_ps(_mm256_loadu_ps(m + j), inv3);
+				sumX = _mm256_fmadd_ps(fj, dx, sumX);
+				sumY = _mm256_fmadd_ps(fj, dy, sumY);
+
+				const __m256 fi = _mm256_mul_ps(mi, inv3);
+				_mm256_storeu_ps(ax + j, _mm256_fnmadd_ps(fi, dx, _mm256_loadu_ps(ax + j)));
+				_mm256_storeu_ps(ay + j, _mm256_fnmadd_ps(fi, dy, _mm256_loadu_ps(ay + j)));
+			}
+
+			float lanesX[8], lanesY[8];
+			_mm256_storeu_ps(lanesX, sumX);
+			_mm256_storeu_ps(lanesY, sumY);
+			for (int lane = 0; lane < 8; ++lane)
+			{
+				ax[i] += lanesX[lane];
+				ay[i] += lanesY[lane];
+			}
+
+			// Remaining partners
+			if (j < j1)
+				tilePair(x, y, m, ax, ay, i, i + 1, j, j1);
+		}
+	}
+#endif
+
+	// Picks the kernel matching the gravity kernel's instruction set
+	// ---------------------------------------------------------------
+	inline void evaluate(const float * x, const float * y, const float * m, float * ax, float * ay, const unsigned int i0, const unsigned int i1, const unsigned int j0, const unsigned int j1)
+	{
+#ifdef GRAVITY_X86
+		if (Gravity::isa == Gravity::AVX2)
+		{
+			tilePairAVX2(x, y, m, ax, ay, i0, i1, j0, j1);
+			return;
+		}
+#endif
+		tilePair(x, y, m, ax, ay, i0, i1, j0, j1);
+	}
+
+	// Writes g * sum_j m_j (x_j - x_i) / |x_j - x_i|^3 into ax, ay
+	// -------------------------------------------------------------
+	inline void accelerate(const float * x, const float * y, const float * m, float * ax, float * ay, const unsigned int n, const float g, ThreadPool& pool)
+	{
+		std::fill(ax, ax + n, 0.0f);
+		std::fill(ay, ay + n, 0.0f);
+
+		const unsigned int nTiles = (n + tileSize - 1) / tileSize;
+		const unsigned int nPairs = nTiles * (nTiles + 1) / 2;
+
+		if (n < minParallelBodies || pool.size() == 1)
+		{
+			for (unsigned int ti = 0; ti < nTiles; ++ti)
+				for (unsigned int tj = ti; tj < nTiles; ++tj)
+					evaluate(x, y, m, ax, ay, ti * tileSize, std::min(n, (ti + 1) * tileSize), tj * tileSize, std::min(n, (tj + 1) * tileSize));
+		}
+		else
+		{
+			// The calling thread's buffers, the pool threads would see their own ones by name
+			std::vector<unsigned int>& pairI = bufferPairI;
+			std::vector<unsigned int>& pairJ = bufferPairJ;
+			std::vector<std::vector<float>>& bx = bufferX;
+			std::vector<std::vector<float>>& by = bufferY;
+
+			// Upper triangle of tile pairs, numbered row by row
+			pairI.resize(nPairs);
+			pairJ.resize(nPairs);
+			for (unsigned int ti = 0, p = 0; ti < nTiles; ++ti)
+			{
+				for (unsigned int tj = ti; tj < nTiles; ++tj, ++p)
+				{
+					pairI[p] = ti;
+					pairJ[p] = tj;
+				}
+			}
+
+			bx.resize(pool.size());
+			by.resize(pool.size());
+			for (unsigned int t = 0; t < pool.size(); ++t)
+			{
+				bx[t].assign(n, 0.0f);
+				by[t].assign(n, 0.0f);
+			}
+
+			pool.parallelFor(nPairs, [&](const unsigned int begin, const unsigned int end, const unsigned int worker)
+			{
+				for (unsigned int p = begin; p < end; ++p)
+				{
+					const unsigned int ti = pairI[p];
+					const unsigned int tj = pairJ[p];
+					evaluate(x, y, m, bx[worker].data(), by[worker].data(), ti * tileSize, std::min(n, (ti + 1) * tileSize), tj * tileSize, std::min(n, (tj + 1) * tileSize));
+				}
+			});
+
+			// Reduce the per-thread buffers, split by bodies
+			pool.parallelFor(n, [&](const unsigned int begin, const unsigned int end, const unsigned int)
+			{
+				for (unsigned int t = 0; t < bx.size(); ++t)
+				{
+					for (unsigned int i = begin; i < end; ++i)
+					{
+						ax[i] += bx[t][i];
+						ay[i] += by[t][i];
+					}
+				}
+			}, tileSize);
+		}
+
+		for (unsigned int i = 0; i < n; ++i)
+		{
+			ax[i] *= g;
+			ay[i] *= g;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef OPENGL_H
+#define OPENGL_H
+
+// OpenGL headers of the game objects
+// Headless builds (-DHEADLESS) only get the GL scalar types the physics is written in. Everything that draws
+// is left out of them, so they need no GL context and link neither GL nor GLFW.
+// -----------------------------------------------------------------------------------------------------------
+#ifdef HEADLESS
+typedef float GLfloat;
+typedef unsigned int GLuint;
+typedef int GLint;
+#else
+#include <glad/glad.h>
+#endif
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include "glm/glm.hpp"	// Vectors
+#include "gravity.hpp"	// SIMD gravity kernels
+#include "quadtree.hpp"	// Barnes-Hut solver
+#include "nbody.hpp"	// Mutual gravitation
+
+#include <vector>
+#include <cmath>
+#include <limits>
+
+// Constants
+const float gameSpeed = 0.5f;
+const float gravityScale = 1.0f;					// Scales gravity force and keeps draw distance consistent
+const float G = gameSpeed * 6.6743f * gravityScale;	// Scaled gravitational constant
+const float epsilon = 0.01f * gravityScale;			// Minimal gravitational force to visualize
+const float barnesHutCrossover = 2048.0f;			// Bodies from which the tree beats the direct SIMD sum at theta = 1, see benchmark.cpp
+
+// Smallest number of bodies the tree is used for with opening angle theta
+// The cost of a tree walk falls roughly with theta^2, the benchmark measures the crossover at 2048 bodies for
+// theta = 1 and 8192 for theta = 0.5. Smaller levels use the direct sum, which is then both faster and exact.
+// -------------------------------------------------------------------------------------------------------------
+inline unsigned int barnesHutMinBodies(const float theta)
+{
+	const float bodies = barnesHutCrossover / (theta * theta);
+	return theta > 0.0f && bodies < 4e9f ? (unsigned int)bodies : std::numeric_limits<unsigned int>::max();
+}
+
+
+// Structure-of-arrays store of all massive bodies in a level
+// Planets, moons etc. are views into this store once bound, probes (space ship, boxes, trajectory) only read it
+// -------------------------------------------------------------------------------------------------------------
+class Bodies
+{
+private:
+	QuadTree tree;
+	float openingAngle = 0.0f;	// Barnes-Hut opening angle theta, 0 = direct summation
+
+public:
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<float> ax;
+	std::vector<float> ay;
+	std::vector<float> mass;
+	std::vector<float> radius;
+	std::vector<float> gravRadius;
+	std::vector<float> previousX;	// Positions before the last physics step, for rendering between steps
+	std::vector<float> previousY;
+
+	// Appends a body and returns its index
+	// ------------------------------------
+	unsigned int add(const float m, const float r, const float gr, const glm::vec2 position, const glm::vec2 velocity)
+	{
+		x.push_back(position.x);
+		y.push_back(position.y);
+		vx.push_back(velocity.x);
+		vy.push_back(velocity.y);
+		ax.push_back(0.0f);
+		ay.push_back(0.0f);
+		mass.push_back(m);
+		radius.push_back(r);
+		gravRadius.push_back(gr);
+		previousX.push_back(position.x);
+		previousY.push_back(position.y);
+		return (unsigned int)x.size() - 1;
+	}
+
+	void clear()
+	{
+		x.clear();
+		y.clear();
+		vx.clear();
+		vy.clear();
+		ax.clear();
+		ay.clear();
+		mass.clear();
+		radius.clear();
+		gravRadius.clear();
+		previousX.clear();
+		previousY.clear();
+		tree.build(nullptr, nullptr, nullptr, 0);
+	}
+
+	// Rebuilds the Barnes-Hut tree from the current positions, needed after the bodies moved
+	// ---------------------------------------------------------------------------------------
+	void buildTree()
+	{
+		if (usesTree())
+			tree.build(x.data(), y.data(), mass.data(), size());
+	}
+
+	// Sum of the gravitational accelerations of all bodies at a given position
+	// ------------------------------------------------------------------------
+	glm::vec2 acceleration(const glm::vec2 position) const
+	{
+		if (usesTree())
+			return tree.acceleration(position, openingAngle, G);
+		return Gravity::sum(x.data(), y.data(), mass.data(), size(), position, G);
+	}
+
+	// The same at count positions given as arrays, e.g. all probes of a batch
+	// ------------------------------------------------------------------------
+	void acceleration(const float * px, const float * py, float * ax, float * ay, const unsigned int count) const
+	{
+		if (usesTree())
+		{
+			for (unsigned int k = 0; k < count; ++k)
+			{
+				const glm::vec2 a = tree.acceleration(glm::vec2(px[k], py[k]), openingAngle, G);
+				ax[k] = a.x;
+				ay[k] = a.y;
+			}
+		}
+		else
+			Gravity::field(x.data(), y.data(), mass.data(), size(), px, py, ax, ay, count, G);
+	}
+
+	// Mutual gravitation between all bodies, written into ax and ay
+	// -------------------------------------------------------------
+	void mutualAcceleration()
+	{
+		NBody::accelerate(x.data(), y.data(), mass.data(), ax.data(), ay.data(), size(), G, getThreadPool());
+	}
+
+	// Index of the first body whose surface is within margin of the position, -1 if none
+	// ----------------------------------------------------------------------------------
+	int collision(const glm::vec2 position, const float margin) const
+	{
+		return collision(x.data(), y.data(), radius.data(), size(), position, margin);
+	}
+
+	// Index of the first body hit on the straight path from -> to, -1 if none
+	// fraction receives the position of the hit along the path in [0, 1]
+	// -------------------------------------------------------------------------
+	int collision(const glm::vec2 from, const glm::vec2 to, const float margin, float& fraction) const
+	{
+		return collision(x.data(), y.data(), radius.data(), size(), from, to, margin, fraction);
+	}
+
+	// Both collision tests on plain arrays, also used for future positions (see ephemeris.hpp)
+	// -----------------------------------------------------------------------------------------
+	static int collision(const float * x, const float * y, const float * radius, const unsigned int n, const glm::vec2 position, const float margin)
+	{
+		for (unsigned int i = 0; i < n; ++i)
+		{
+			const float dx = x[i] - position.x;
+			const float dy = y[i] - position.y;
+			if (std::sqrt(dx * dx + dy * dy) - radius[i] <= margin)
+				return (int)i;
+		}
+
+		return -1;
+	}
+
+	static int collision(const float * x, const float * y, const float * radius, const unsigned int n, const glm::vec2 from, const glm::vec2 to, const float margin, float& fraction)
+	{
+		const glm::vec2 d = to - from;
+		const float dd = glm::dot(d, d);
+		int hit = -1;
+		fraction = 1.0f;
+
+		for (unsigned int i = 0; i < n; ++i)
+		{
+			// Solve |from + t d - center| = radius + margin for the smaller t
+			const glm::vec2 f = from - glm::vec2(x[i], y[i]);
+			const float r = radius[i] + margin;
+			const float c = glm::dot(f, f) - r * r;
+			if (c <= 0.0f)
+			{
+				fraction = 0.0f;
+				return (int)i;
+			}
+			if (dd == 0.0f)
+				continue;
+
+			const float b = glm::dot(f, d);
+			const float discriminant = b * b - dd * c;
+			if (b >= 0.0f || discriminant < 0.0f)
+				continue;
+
+			const float t = (-b - std::sqrt(discriminant)) / dd;
+			if (t <= fraction)
+			{
+				fraction = t;
+				hit = (int)i;
+			}
+		}
+
+		return hit;
+	}
+
+	// Integrator building blocks for the bodies in [first, last), see integrator.hpp
+	// ------------------------------------------------------------------------------
+	void kick(const unsigned int first, const unsigned int last, const float dt)
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			vx[i] += dt * ax[i];
+			vy[i] += dt * ay[i];
+		}
+	}
+	void drift(const unsigned int first, const unsigned int last, const float dt)
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			x[i] += dt * vx[i];
+			y[i] += dt * vy[i];
+		}
+	}
+
+	// Keeps the current positions as the previous state, called before every physics step
+	// -------------------------------------------------------------------------------------
+	void saveState()
+	{
+		previousX = x;
+		previousY = y;
+	}
+
+	// Copies the bodies of a store of the same size without allocating, for drawing only (the tree is not copied)
+	// ------------------------------------------------------------------------------------------------------------
+	void copyState(const Bodies& source)
+	{
+		x = source.x;
+		y = source.y;
+		vx = source.vx;
+		vy = source.vy;
+		ax = source.ax;
+		ay = source.ay;
+		mass = source.mass;
+		radius = source.radius;
+		gravRadius = source.gravRadius;
+		previousX = source.previousX;
+		previousY = source.previousY;
+	}
+
+	void setOpeningAngle(const float theta)
+	{
+		openingAngle = theta;
+		buildTree();
+	}
+
+	// Getter functions
+	bool usesTree() const
+	{
+		return openingAngle > 0.0f && size() >= barnesHutMinBodies(openingAngle);
+	}
+	unsigned int size() const
+	{
+		return (unsigned int)x.size();
+	}
+	glm::vec2 getPosition(const unsigned int i) const
+	{
+		return glm::vec2(x[i], y[i]);
+	}
+	// Position blended between the previous and the current physics step, alpha in [0, 1]
+	glm::vec2 getPosition(const unsigned int i, const float alpha) const
+	{
+		return glm::vec2(previousX[i] + alpha * (x[i] - previousX[i]), previousY[i] + alpha * (y[i] - previousY[i]));
+	}
+	glm::vec2 getVelocity(const unsigned int i) const
+	{
+		return glm::vec2(vx[i], vy[i]);
+	}
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include "glm/glm.hpp"	// Vectors
+#include "gravity.hpp"	// Direct summation inside leaves
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Barnes-Hut quadtree approximating the gravity of many bodies
+// A cell is treated as a single point mass at its center of mass if cellSize / distance < theta,
+// otherwise its children are opened. Leaves hold up to leafSize bodies that are summed directly.
+// ------------------------------------------------------------------------------------------------
+class QuadTree
+{
+private:
+	struct Node
+	{
+		glm::vec2 centerOfMass = glm::vec2(0.0f, 0.0f);
+		float mass = 0.0f;
+		float size = 0.0f;		// Edge length of the square cell
+		int firstChild = -1;	// Children are stored consecutively, -1 for leaves
+		int firstBody = 0;		// Range of the bodies in the leaf
+		int bodyCount = 0;
+	};
+
+	std::vector<Node> nodes;
+
+	// Copy of the bodies, sorted so each leaf covers a contiguous range
+	std::vector<int> order;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> m;
+
+	static const int leafSize = 8;
+	static const int maxDepth = 24;	// Stops splitting coincident bodies
+
+	// Splits the bodies [begin, end) of a node into four quadrants
+	// -------------------------------------------------------------
+	void split(const int index, const glm::vec2 center, const float halfSize, const int begin, const int end, const int depth)
+	{
+		if (end - begin <= leafSize || depth >= maxDepth)
+			return;
+
+		// Partition by y first, then both halves by x: quadrant = (x >= cx) + 2 * (y >= cy)
+		int * first = order.data() + begin;
+		int * last = order.data() + end;
+		int * midY = std::partition(first, last, [&](int i) { return y[i] < center.y; });
+		int * midX0 = std::partition(first, midY, [&](int i) { return x[i] < center.x; });
+		int * midX1 = std::partition(midY, last, [&](int i) { return x[i] < center.x; });
+		int * bounds[5] = { first, midX0, midY, midX1, last };
+
+		const int child = (int)nodes.size();
+		nodes[index].firstChild = child;
+		const float quarter = 0.5f * halfSize;
+
+		for (int q = 0; q < 4; ++q)
+		{
+			Node node;
+			node.size = halfSize;
+			node.firstBody = (int)(bounds[q] - order.data());
+			node.bodyCount = (int)(bounds[q + 1] - bounds[q]);
+			nodes.push_back(node);
+		}
+
+		for (int q = 0; q < 4; ++q)
+		{
+			const glm::vec2 childCenter = center + glm::vec2(q & 1 ? quarter : -quarter, q & 2 ? quarter : -quarter);
+			const int childBegin = nodes[child + q].firstBody;
+			split(child + q, childCenter, quarter, childBegin, childBegin + nodes[child + q].bodyCount, depth + 1);
+		}
+	}
+
+public:
+	// Rebuilds the tree for n bodies, the arrays are copied
+	// ------------------------------------------------------
+	void build(const float * px, const float * py, const float * mass, const unsigned int n)
+	{
+		nodes.clear();
+		if (n == 0)
+			return;
+
+		x.assign(px, px + n);
+		y.assign(py, py + n);
+		m.assign(mass, mass + n);
+		order.resize(n);
+		for (unsigned int i = 0; i < n; ++i)
+			order[i] = (int)i;
+
+		// Square root cell enclosing all bodies
+		const float minX = *std::min_element(px, px + n);
+		const float maxX = *std::max_element(px, px + n);
+		const float minY = *std::min_element(py, py + n);
+		const float maxY = *std::max_element(py, py + n);
+		const float halfSize = 0.5f * std::max(maxX - minX, maxY - minY) + 1.0f;
+
+		Node root;
+		root.size = 2.0f * halfSize;
+		root.bodyCount = (int)n;
+		nodes.push_back(root);
+		split(0, glm::vec2(0.5f * (minX + maxX), 0.5f * (minY + maxY)), halfSize, 0, (int)n, 0);
+
+		// Store the bodies in leaf order
+		std::vector<float> sorted(n);
+		for (unsigned int i = 0; i < n; ++i)
+			sorted[i] = x[order[i]];
+		x.swap(sorted);
+		for (unsigned int i = 0; i < n; ++i)
+			sorted[i] = y[order[i]];
+		y.swap(sorted);
+		for (unsigned int i = 0; i < n; ++i)
+			sorted[i] = m[order[i]];
+		m.swap(sorted);
+
+		// Mass and center of mass bottom-up, children always come after their parent
+		for (int i = (int)nodes.size() - 1; i >= 0; --i)
+		{
+			Node& node = nodes[i];
+			glm::vec2 weighted(0.0f, 0.0f);
+			node.mass = 0.0f;
+
+			if (node.firstChild == -1)
+			{
+				for (int b = node.firstBody; b < node.firstBody + node.bodyCount; ++b)
+				{
+					node.mass += m[b];
+					weighted += m[b] * glm::vec2(x[b], y[b]);
+				}
+			}
+			else
+			{
+				for (int q = 0; q < 4; ++q)
+				{
+					const Node& child = nodes[node.firstChild + q];
+					node.mass += child.mass;
+					weighted += child.mass * child.centerOfMass;
+				}
+			}
+
+			if (node.mass > 0.0f)
+				node.centerOfMass = weighted / node.mass;
+		}
+	}
+
+	// Approximated acceleration at position, theta = 0 degenerates to the direct sum
+	// ------------------------------------------------------------------------------
+	glm::vec2 acceleration(const glm::vec2 position, const float theta, const float g) const
+	{
+		glm::vec2 sum(0.0f, 0.0f);
+		if (nodes.empty())
+			return sum;
+
+		const float theta2 = theta * theta;
+		int stack[3 * maxDepth + 4];	// Depth-first, at most 3 siblings wait per level
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+
+			if (node.mass == 0.0f)
+				continue;
+
+			const glm::vec2 rv = node.centerOfMass - position;
+			const float r2 = glm::dot(rv, rv);
+
+			// Far enough away: size / r < theta
+			if (node.size * node.size < theta2 * r2)
+				sum += g * node.mass / (r2 * std::sqrt(r2)) * rv;
+			else if (node.firstChild == -1)
+				sum += Gravity::sum(&x[node.firstBody], &y[node.firstBody], &m[node.firstBody], node.bodyCount, position, g);
+			else
+			{
+				for (int q = 0; q < 4; ++q)
+					stack[top++] = node.firstChild + q;
+			}
+		}
+
+		return sum;
+	}
+
+	unsigned int getNodeCount() const
+	{
+		return (unsigned int)nodes.size();
+	}
+};
+
+#endif
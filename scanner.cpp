@@ -0,0 +1,436 @@
+// Checks whether the levels can be won, without opening a window
+// Compile: g++ -std=c++1z scanner.cpp -o scanner -O3 -lstdc++fs -lpthread
+// Usage: scanner [-a degrees] [-s speed] [-b ticks] [-B ticks] [-t ticks] [-f] [-o file] [level names]
+// -------------------------------------------------------------------------------------------------------------------
+
+#ifndef HEADLESS
+#define HEADLESS		// Game objects without their draw code, see opengl.hpp
+#endif
+
+#include "glm/glm.hpp"
+#include "level.hpp"
+#include "thread_pool.hpp"	// Launch settings are spread over all cores
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+#if __has_include(<filesystem>)
+#include <filesystem>
+#elif __has_include(<experimental/filesystem>)
+#include <experimental/filesystem>
+#endif
+namespace fs = std::experimental::filesystem;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Seconds elapsed since start
+double elapsed(const Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// Grid of launch settings tried on every level
+// ---------------------------------------------
+struct Sweep
+{
+	float angleStep = 1.0f;				// Degrees
+	float speedStep = 0.25f;			// Launch speed, from minLaunchSpeed to maxLaunchSpeed
+	unsigned int boostSpacing = 50;		// Game ticks between boost times after the launch, 0 = no boost
+	unsigned int lastBoost = 500;		// Latest boost time
+	unsigned int ticks = 2000;			// Flight time of a shot, longer flights count as misses
+	bool first = false;					// Stop a level at its first win
+	std::string report = "scan_report.txt";
+
+	unsigned int angles() const
+	{
+		return std::max(1u, (unsigned int)std::round(360.0f / angleStep));
+	}
+	unsigned int speeds() const
+	{
+		return (unsigned int)((maxLaunchSpeed - minLaunchSpeed) / speedStep + 1.0e-3f) + 1;
+	}
+	// Boost time 0 stands for no boost
+	unsigned int boosts() const
+	{
+		return 1 + (boostSpacing ? lastBoost / boostSpacing : 0);
+	}
+};
+
+enum Outcome { NONE, WON, CRASHED, LOST, TIMEOUT };	// NONE: the ship was down before the boost time
+
+struct Shot
+{
+	Outcome outcome = NONE;
+	float miss = std::numeric_limits<float>::max();	// Closest distance of the ship's collision circle to the target's surface
+};
+
+// State of a ship in flight
+struct Probe
+{
+	glm::vec2 position, velocity, acceleration;
+	float stepSize = 0;
+	float time = 0;
+	float outside = 0;		// Game ticks spent outside the window
+	float miss = std::numeric_limits<float>::max();
+};
+
+// Everything a shot reads from the level, shared by all threads
+// --------------------------------------------------------------
+struct Scene
+{
+	const Bodies * bodies;
+	const Ephemeris * ephemeris;		// nullptr = bodies frozen, like the trajectory preview
+	Integrator::Settings integration;
+	unsigned int target;
+	glm::vec2 start;					// Center of the start planet
+	float axis;							// Distance of the ship from it
+
+	glm::vec2 acceleration(const glm::vec2 p, const unsigned int step) const
+	{
+		return ephemeris ? ephemeris->acceleration(step, p) : bodies->acceleration(p);
+	}
+	int collision(const glm::vec2 p, const unsigned int step) const
+	{
+		return ephemeris ? ephemeris->collision(step, p, collisionShip) : bodies->collision(p, collisionShip);
+	}
+	glm::vec2 targetPosition(const unsigned int step) const
+	{
+		return ephemeris ? ephemeris->getPosition(step, target) : glm::vec2(bodies->x[target], bodies->y[target]);
+	}
+};
+
+// Flies a probe like SpaceShip::move() in the game loop, the launch happens on the first tick of the level
+// The state after every boost time the ship lives to see is copied to checkpoints[boost time / spacing]
+// ---------------------------------------------------------------------------------------------------------
+Outcome fly(const Scene& scene, Probe& probe, const unsigned int ticks, const unsigned int spacing, std::vector<Probe>& checkpoints, unsigned long long& steps)
+{
+	const float radius = scene.bodies->radius[scene.target] + collisionShip;
+	const float timeStep = scene.integration.timeStep;
+	unsigned int boost = spacing ? (unsigned int)(probe.time / spacing) + 1 : 0;
+
+	while (probe.time < ticks)
+	{
+		const unsigned int step = scene.ephemeris ? scene.ephemeris->getStep(probe.time) : 0;
+		auto field = [&](const glm::vec2 p) { return scene.acceleration(p, step); };
+
+		if (Integrator::reusesAcceleration(scene.integration))
+			probe.acceleration = field(probe.position);
+		Integrator::advance(scene.integration, probe.position, probe.velocity, probe.acceleration, probe.stepSize, field);
+		const bool first = probe.time == 0;
+		probe.time += timeStep;
+		++steps;
+
+		probe.miss = std::min(probe.miss, glm::distance(probe.position, scene.targetPosition(step)) - radius);
+
+		// The first step after the launch has no collision test
+		const int body = first ? -1 : scene.collision(probe.position, step);
+		if (body >= 0)
+			return body == (int)scene.target ? WON : CRASHED;
+
+		if (loseSignal(probe.position, timeStep, probe.outside))
+			return LOST;
+
+		// Boosts are given between steps, the first one after the boost time
+		for (; spacing && boost < checkpoints.size() && probe.time >= boost * spacing; ++boost)
+			checkpoints[boost] = probe;
+	}
+	return TIMEOUT;
+}
+
+
+// Result of one level
+// --------------------
+struct Scan
+{
+	std::string name;
+	unsigned int bodies = 0;
+	bool moving = false;
+	bool frozen = false;				// Moving, but too many bodies for an ephemeris
+	std::vector<Shot> shots;			// Angle major, then speed, then boost time
+	unsigned long long steps = 0;		// Physics steps of all shots
+	unsigned int flown = 0;				// Shots that exist, a boost needs the ship still flying
+	double time = 0;
+	bool stopped = false;				// Ended at the first win
+};
+
+Scan scanLevel(const std::string& filePath, const Sweep& sweep)
+{
+	Scan scan;
+	Level level(filePath);
+	level.genPhysics();
+	scan.name = level.getName();
+	scan.bodies = level.getBodies().size();
+	scan.moving = level.getEphemeris() != nullptr;
+	if (!scan.moving)
+	{
+		Level next(level);
+		next.rebind();
+		next.updatePhysics();
+		scan.frozen = next.getStateVersion() != 0;
+	}
+
+	const unsigned int start = level.getTargetBody() - 1;
+	const Scene scene = { &level.getBodies(), level.getEphemeris(), level.getIntegration(), level.getTargetBody(),
+		glm::vec2(level.getBodies().x[start], level.getBodies().y[start]), level.getBodies().radius[start] + spaceShipSize };
+
+	const unsigned int angles = sweep.angles(), speeds = sweep.speeds(), boosts = sweep.boosts();
+	scan.shots.resize(angles * speeds * boosts);
+	std::atomic<bool> won(false);
+	std::atomic<unsigned long long> steps(0);
+	std::atomic<unsigned int> flown(0);
+
+	const Clock::time_point begin = Clock::now();
+	getThreadPool().parallelFor(angles * speeds, [&](const unsigned int first, const unsigned int last, const unsigned int)
+	{
+		std::vector<Probe> checkpoints(boosts);
+		unsigned long long localSteps = 0;
+		unsigned int localFlown = 0;
+
+		for (unsigned int setting = first; setting < last; ++setting)
+		{
+			if (sweep.first && won)
+				break;
+
+			const float angle = glm::radians((setting / speeds) * sweep.angleStep);
+			const float speed = std::min(maxLaunchSpeed, minLaunchSpeed + (setting % speeds) * sweep.speedStep);
+			const glm::vec2 direction(std::cos(angle), std::sin(angle));
+			Shot * shots = &scan.shots[setting * boosts];
+
+			// The unboosted flight leaves a checkpoint at every boost time, boosted shots continue from there
+			Probe probe;
+			probe.position = scene.start + scene.axis * direction;
+			probe.velocity = speed * direction;
+			for (Probe& checkpoint : checkpoints)
+				checkpoint.time = -1;
+			shots[0].outcome = fly(scene, probe, sweep.ticks, sweep.boostSpacing, checkpoints, localSteps);
+			shots[0].miss = probe.miss;
+			++localFlown;
+
+			for (unsigned int boost = 1; boost < boosts; ++boost)
+			{
+				Probe& branch = checkpoints[boost];
+				if (branch.time < 0)
+					break;
+				// SpaceShip::launchProgress() boosts along the heading, which follows the velocity
+				branch.velocity += boostPower * glm::normalize(branch.velocity);
+				shots[boost].outcome = fly(scene, branch, sweep.ticks, 0, checkpoints, localSteps);
+				shots[boost].miss = branch.miss;
+				++localFlown;
+			}
+
+			for (unsigned int boost = 0; boost < boosts; ++boost)
+			{
+				if (shots[boost].outcome == WON)
+					won = true;
+			}
+		}
+
+		steps += localSteps;
+		flown += localFlown;
+	});
+	scan.time = elapsed(begin);
+	scan.steps = steps;
+	scan.flown = flown;
+	scan.stopped = sweep.first && won;
+	return scan;
+}
+
+
+// Writes the findings on one level, returns false if it can't be won
+// -------------------------------------------------------------------
+bool report(std::ostream& out, const Scan& scan, const Sweep& sweep)
+{
+	const unsigned int angles = sweep.angles(), speeds = sweep.speeds(), boosts = sweep.boosts();
+	auto shot = [&](const int angle, const int speed, const unsigned int boost) -> const Shot&
+	{
+		return scan.shots[((unsigned int)((angle + angles) % angles) * speeds + speed) * boosts + boost];
+	};
+
+	// Share of the angle x speed plane that wins without a boost, and with a boost at some time or none
+	unsigned int plain = 0, any = 0;
+	for (unsigned int setting = 0; setting < angles * speeds; ++setting)
+	{
+		plain += scan.shots[setting * boosts].outcome == WON;
+		for (unsigned int boost = 0; boost < boosts; ++boost)
+		{
+			if (scan.shots[setting * boosts + boost].outcome == WON)
+			{
+				++any;
+				break;
+			}
+		}
+	}
+
+	// Best shot: wins without boost score more, then early boosts. Among those the one with the most winning
+	// neighbours on the grid is the easiest to hit. Without any win, the closest miss.
+	int bestAngle = -1, bestSpeed = 0, bestBoost = 0, bestNeighbours = -1;
+	float closest = std::numeric_limits<float>::max();
+	for (unsigned int boost = 0; boost < boosts && bestNeighbours < 0; ++boost)
+	{
+		for (int angle = 0; angle < (int)angles; ++angle)
+		{
+			for (int speed = 0; speed < (int)speeds; ++speed)
+			{
+				if (shot(angle, speed, boost).outcome != WON)
+					continue;
+				int neighbours = 0;
+				for (int da = -1; da <= 1; ++da)
+				{
+					for (int ds = -1; ds <= 1; ++ds)
+						neighbours += speed + ds >= 0 && speed + ds < (int)speeds && shot(angle + da, speed + ds, boost).outcome == WON;
+				}
+				if (neighbours > bestNeighbours)
+				{
+					bestNeighbours = neighbours;
+					bestAngle = angle;
+					bestSpeed = speed;
+					bestBoost = boost;
+				}
+			}
+		}
+	}
+	if (bestAngle < 0)
+	{
+		for (unsigned int setting = 0; setting < angles * speeds; ++setting)
+		{
+			for (unsigned int boost = 0; boost < boosts; ++boost)
+			{
+				const Shot& candidate = scan.shots[setting * boosts + boost];
+				if (candidate.outcome != NONE && candidate.miss < closest)
+				{
+					closest = candidate.miss;
+					bestAngle = setting / speeds;
+					bestSpeed = setting % speeds;
+					bestBoost = boost;
+				}
+			}
+		}
+	}
+
+	out << "Level: " << scan.name << std::endl;
+	out << "  Bodies: " << scan.bodies << (scan.moving ? " (moving)" : scan.frozen ? " (moving, too many to precompute, scanned frozen)" : " (static)") << ", sweep " << angles << " angles x " << speeds << " speeds x "
+		<< boosts << " boost times (incl. none), " << sweep.ticks << " ticks per shot" << std::endl;
+
+	out << std::fixed << std::setprecision(2);
+	if (scan.stopped)
+		out << "  Winning region: not measured, stopped at the first win" << std::endl;
+	else if (any)
+		out << "  Winning region: " << 100.0 * plain / (angles * speeds) << "% of launch settings without boost, " << 100.0 * any / (angles * speeds) << "% with boost" << std::endl;
+	else
+		out << "  Winning region: none, the level can't be won within " << sweep.ticks << " ticks" << std::endl;
+
+	if (bestAngle >= 0)
+	{
+		const float speed = std::min(maxLaunchSpeed, minLaunchSpeed + bestSpeed * sweep.speedStep);
+		out << std::setprecision(1) << "  " << (bestNeighbours >= 0 ? "Best shot" : "Closest miss") << ": angle " << bestAngle * sweep.angleStep
+			<< std::setprecision(2) << ", launch speed " << speed << " (shown as " << 2.0f * speed - 1.0f << "), ";
+		if (bestBoost)
+			out << "boost " << bestBoost * sweep.boostSpacing << " ticks after the launch";
+		else
+			out << "no boost";
+		if (bestNeighbours >= 0 && scan.stopped)
+			out << ", score " << (bestBoost ? 100 : 200) << std::endl;
+		else if (bestNeighbours >= 0)
+			out << ", score " << (bestBoost ? 100 : 200) << ", " << bestNeighbours - 1 << " of 8 neighbours win" << std::endl;
+		else
+			out << ", " << closest << " px from the target" << std::endl;
+	}
+
+	out << std::setprecision(2) << "  Throughput: " << scan.flown << " shots in " << scan.time << " s, " << scan.steps / scan.time / 1.0e6
+		<< " M ticks/s on " << getThreadPool().size() << " threads" << std::endl << std::endl;
+	out.unsetf(std::ios::floatfield);
+	return any > 0;
+}
+
+
+int main(int argc, char * argv[])
+{
+	Sweep sweep;
+	std::vector<std::string> files;
+
+	// Options first, the remaining arguments are level names as for the game
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (argument == "-a" && hasValue)
+			sweep.angleStep = std::max(0.01f, (float)std::atof(argv[++i]));
+		else if (argument == "-s" && hasValue)
+			sweep.speedStep = std::max(0.01f, (float)std::atof(argv[++i]));
+		else if (argument == "-b" && hasValue)
+			sweep.boostSpacing = std::atoi(argv[++i]);
+		else if (argument == "-B" && hasValue)
+			sweep.lastBoost = std::atoi(argv[++i]);
+		else if (argument == "-t" && hasValue)
+			sweep.ticks = std::atoi(argv[++i]);
+		else if (argument == "-f")
+			sweep.first = true;
+		else if (argument == "-o" && hasValue)
+			sweep.report = argv[++i];
+		else if (argument[0] == '-')
+		{
+			std::cout << "Usage: scanner [-a degrees] [-s speed] [-b ticks] [-B ticks] [-t ticks] [-f] [-o file] [level names]" << std::endl;
+			std::cout << "  -a  Launch angle step in degrees (" << sweep.angleStep << ")" << std::endl;
+			std::cout << "  -s  Launch speed step (" << sweep.speedStep << ")" << std::endl;
+			std::cout << "  -b  Game ticks between boost times, 0 = no boost (" << sweep.boostSpacing << ")" << std::endl;
+			std::cout << "  -B  Latest boost time in game ticks after the launch (" << sweep.lastBoost << ")" << std::endl;
+			std::cout << "  -t  Flight time of a shot in game ticks (" << sweep.ticks << ")" << std::endl;
+			std::cout << "  -f  Stop every level at its first win" << std::endl;
+			std::cout << "  -o  Report file (" << sweep.report << ")" << std::endl;
+			return 2;
+		}
+		else
+			files.push_back("levels/" + argument + ".lvl");
+	}
+
+	if (files.empty())
+	{
+		for (const auto & file : fs::directory_iterator("levels"))
+		{
+			const std::string filePath = file.path().string();
+			if (filePath.substr(filePath.length() - 4) == ".lvl")
+				files.push_back(filePath);
+		}
+		std::sort(files.begin(), files.end());
+	}
+
+	std::ofstream reportFile(sweep.report);
+	if (!reportFile.is_open())
+		std::cout << "Error: Can't write " << sweep.report << std::endl;
+
+	unsigned int unsolvable = 0;
+	const Clock::time_point start = Clock::now();
+	for (const std::string& filePath : files)
+	{
+		if (!Level(filePath).isValid())
+		{
+			std::cout << "Error: Skipped invalid level " << filePath << std::endl;
+			continue;
+		}
+
+		const Scan scan = scanLevel(filePath, sweep);
+		std::ostringstream text;
+		if (!report(text, scan, sweep))
+			++unsolvable;
+		std::cout << text.str();
+		reportFile << text.str();
+	}
+
+	std::ostringstream summary;
+	summary << files.size() << " levels scanned in " << elapsed(start) << " s, " << unsolvable << " can't be won" << std::endl;
+	std::cout << summary.str();
+	reportFile << summary.str();
+
+	// Non-zero if a level can't be won, so level packs can be checked by scripts
+	return unsolvable ? 1 : 0;
+}
@@ -1,7 +1,7 @@
 #ifndef SHAPES_H
 #define SHAPES_H
 
-#include <glad/glad.h>	// OpenGL headers
+#include "opengl.hpp"		// OpenGL headers, only the types in headless builds
 #include "glm/glm.hpp"
 #include <cmath>
 #include <iostream>
@@ -16,7 +16,7 @@ const GLint nVertices = nSegments + 2;
 const GLint nSegmentsLow = 10;
 const GLint nVerticesLow = nSegmentsLow + 2;
 
-GLfloat * getDisk()
+inline GLfloat * getDisk()
 {
 	static GLfloat vertices[nVertices * 2] = { 0.0f };	// initialize triangle fan with center in (0,0)
 
@@ -29,7 +29,7 @@ GLfloat * getDisk()
 	return vertices;
 }
 
-GLfloat * getLowPolyDisk()
+inline GLfloat * getLowPolyDisk()
 {
 	static GLfloat vertices[nVertices * 2] = { 0.0f };	// initialize triangle fan with center in (0,0)
 
@@ -43,7 +43,7 @@ GLfloat * getLowPolyDisk()
 }
 
 
-GLfloat * getSpaceShip()
+inline GLfloat * getSpaceShip()
 {
 	static GLfloat vertices[12] = {
 		 -1.0f,  0.42f,
@@ -58,7 +58,7 @@ GLfloat * getSpaceShip()
 }
 
 
-GLfloat * getBox()
+inline GLfloat * getBox()
 {
 	static GLfloat vertices[12] = {
 		-1.0f, -0.75f,
@@ -73,7 +73,7 @@ GLfloat * getBox()
 }
 
 
-GLfloat * getFlagPole()
+inline GLfloat * getFlagPole()
 {
 	static GLfloat vertices[12] = {
 		-0.05f, -1.0f,
@@ -87,7 +87,7 @@ GLfloat * getFlagPole()
 	return vertices;
 }
 
-GLfloat * getFlag()
+inline GLfloat * getFlag()
 {
 	static GLfloat vertices[12] = {
 		0.0f, 0.2f,
@@ -0,0 +1,142 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Persistent worker threads for data parallel loops
+// The calling thread takes part as worker 0, so a pool of size 1 has no extra threads
+// ------------------------------------------------------------------------------------
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::mutex busy;					// Held by the thread currently running a loop
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(unsigned int)> * task = nullptr;
+	unsigned int generation = 0;
+	unsigned int pending = 0;
+	bool stopping = false;
+
+	void loop(const unsigned int index)
+	{
+		unsigned int seen = 0;
+
+		while (true)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+			const std::function<void(unsigned int)> * current = task;
+			lock.unlock();
+
+			(*current)(index);
+
+			lock.lock();
+			if (--pending == 0)
+				done.notify_one();
+		}
+	}
+
+public:
+	// Constructor
+	// Arguments: total number of threads including the caller, 0 = one per hardware thread
+	// -------------------------------------------------------------------------------------
+	ThreadPool(unsigned int nThreads = 0)
+	{
+		if (nThreads == 0)
+			nThreads = std::thread::hardware_concurrency();
+		if (nThreads == 0)
+			nThreads = 1;
+
+		for (unsigned int i = 1; i < nThreads; ++i)
+			workers.push_back(std::thread(&ThreadPool::loop, this, i));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto & worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Runs job(worker) once on every thread and returns when all are finished
+	// If the pool is already in use (e.g. called from inside a job) everything runs on the caller
+	// --------------------------------------------------------------------------------------------
+	void run(const std::function<void(unsigned int)>& job)
+	{
+		std::unique_lock<std::mutex> owner(busy, std::try_to_lock);
+		if (!owner.owns_lock() || workers.empty())
+		{
+			for (unsigned int i = 0; i < size(); ++i)
+				job(i);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &job;
+			pending = (unsigned int)workers.size();
+			++generation;
+		}
+		wake.notify_all();
+
+		job(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return pending == 0; });
+		task = nullptr;
+	}
+
+	// Splits [0, count) into chunks of grain items that are handed out dynamically
+	// Arguments: count, body(begin, end, worker), grain
+	// ----------------------------------------------------------------------------
+	void parallelFor(const unsigned int count, const std::function<void(unsigned int, unsigned int, unsigned int)>& body, const unsigned int grain = 1)
+	{
+		if (count == 0)
+			return;
+		if (count <= grain || size() == 1)
+		{
+			body(0, count, 0);
+			return;
+		}
+
+		std::atomic<unsigned int> next(0);
+		run([&](const unsigned int worker)
+		{
+			for (unsigned int begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain))
+				body(begin, begin + grain < count ? begin + grain : count, worker);
+		});
+	}
+
+	// Getter functions
+	unsigned int size() const
+	{
+		return (unsigned int)workers.size() + 1;
+	}
+};
+
+// Shared pool with one thread per core, started on first use, one for all translation units
+// -----------------------------------------------------------------------------------------
+inline ThreadPool& getThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef TRAJECTORY_WORKER_H
+#define TRAJECTORY_WORKER_H
+
+#include "opengl.hpp"
+
+#include "game_objects.hpp"	// Trajectory, SpaceShip
+#include "ensemble.hpp"		// Uncertainty band
+#include "level.hpp"
+#include "channels.hpp"		// Lock-free hand-over between threads
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Trajectory prediction on a background thread
+// The simulation posts the launch parameters, the worker always continues with the newest ones and
+// skips everything posted in between. It predicts against its own replica of the level, stepped to the
+// same physics step as the simulation, so neither thread waits for or reads the state of the other.
+// Samples are handed to the render thread through a triple buffer, one slice of steps at a time, so the
+// start of the path shows up at once and newer requests are picked up between slices. Without a second
+// hardware thread the slices are computed by the posting thread instead, one per post().
+// On request the Monte Carlo ensemble is launched as well, once the path it surrounds is complete.
+// -----------------------------------------------------------------------------------------------------
+class TrajectoryWorker
+{
+public:
+	struct Request
+	{
+		std::shared_ptr<const Level> level;	// Copy of the level right after genPhysics()
+		SpaceShip player;
+		unsigned int generation = 0;		// Number of levels posted, a new one restarts the replica
+		unsigned int version = 0;			// Level::getStateVersion() of the simulation
+		unsigned int horizon = 0;			// Game ticks to predict
+		bool ensemble = false;				// Also compute the uncertainty band
+		std::shared_ptr<const Bodies> bodies;	// Current bodies of moving levels without an ephemeris
+	};
+
+	struct Result
+	{
+		std::vector<GLfloat> samples;
+		std::vector<GLfloat> band;			// Empty unless requested, see Ensemble
+		GLfloat hitChance = 0;
+		unsigned int generation = 0;		// Level the samples belong to
+	};
+
+private:
+	const unsigned int TTL;
+	const unsigned int stepBudget;		// Steps per slice
+	const bool threaded;
+
+	// Simulation thread only
+	std::shared_ptr<const Level> level;
+	unsigned int generation = 0;
+
+	// Worker thread only (posting thread if not threaded)
+	std::unique_ptr<Level> replica;
+	std::unique_ptr<SpaceShip> player;
+	std::unique_ptr<Trajectory> trajectory;
+	std::unique_ptr<Ensemble> ensemble;
+	unsigned int replicaGeneration = 0;
+	unsigned int version = 0;
+	bool ensembleOn = false;
+
+	TripleBuffer<Request> requests;
+	TripleBuffer<Result> results;
+	std::atomic<bool> running;
+	std::thread worker;
+
+	static constexpr std::chrono::milliseconds idle = std::chrono::milliseconds(1);
+
+	// Starts a new replica from the level of a request
+	// -------------------------------------------------
+	void restart(const Request& request)
+	{
+		replica.reset(new Level(*request.level));
+		replica->genPhysics();
+		player.reset(new SpaceShip(request.player));
+		trajectory.reset(new Trajectory(*player, replica->getBodies(), TTL, replica->getIntegration(), replica->getEphemeris(), stepBudget));
+		ensemble.reset(new Ensemble(replica->getBodies(), TTL, replica->getIntegration(), replica->getEphemeris()));
+		replicaGeneration = request.generation;
+	}
+
+	// Takes over the state of the simulation given by a request
+	// -----------------------------------------------------------
+	void accept(const Request& request)
+	{
+		// The simulation only moves forward within a level, stepping back needs a new replica
+		if (!replica || request.generation != replicaGeneration || (replica->getEphemeris() && request.version < replica->getStepCount()))
+			restart(request);
+
+		// Catch up with the simulation, the replica computes its own ephemeris
+		if (replica->getEphemeris())
+		{
+			while (replica->getStepCount() < request.version && (running || !threaded))
+				replica->updatePhysics();
+		}
+		else if (request.bodies)
+			replica->getBodies() = *request.bodies;
+
+		*player = request.player;
+		trajectory->setHorizon(request.horizon);
+		version = request.version;
+		ensembleOn = request.ensemble;
+	}
+
+	// Computes one slice and hands the samples so far to the render thread
+	// ---------------------------------------------------------------------
+	void slice()
+	{
+		trajectory->update(version);
+		// The ensemble takes far longer than a slice, until it catches up the previous band stays
+		if (ensembleOn && trajectory->isComplete())
+			ensemble->update(*player, replica->getTargetBody(), version);
+
+		// Each slot is reserved for a full line strip and band once, copies never allocate after that
+		Result& result = results.getBack();
+		result.samples.reserve(2 * Trajectory::maxSamples);
+		result.samples = trajectory->getSamples();
+		result.band.reserve(ensemble->getBand().capacity());
+		if (ensembleOn)
+			result.band = ensemble->getBand();
+		else
+			result.band.clear();
+		result.hitChance = ensembleOn ? ensemble->getHitChance() : 0.0f;
+		result.generation = replicaGeneration;
+		results.publish();
+	}
+
+	void loop()
+	{
+		while (running)
+		{
+			if (requests.hasNew())
+			{
+				const Request& request = requests.read();
+				if (!request.level)
+					continue;
+				accept(request);
+			}
+			else if (!trajectory || trajectory->isComplete())
+			{
+				std::this_thread::sleep_for(idle);
+				continue;
+			}
+
+			slice();
+		}
+	}
+
+public:
+	// Constructor
+	// Arguments: any space ship (only fills the unused request slots), integrated game ticks of the prediction,
+	// steps per slice (0 = whole predictions)
+	// ---------------------------------------------------------------------------------------------------------
+	TrajectoryWorker(const SpaceShip& player, const unsigned int TTL, const unsigned int stepBudget = 0)
+		: TTL(TTL), stepBudget(stepBudget), threaded(std::thread::hardware_concurrency() > 1), requests(Request{ nullptr, player }), results(Result()), running(true)
+	{
+		if (threaded)
+			worker = std::thread(&TrajectoryWorker::loop, this);
+	}
+
+	~TrajectoryWorker()
+	{
+		running = false;
+		if (worker.joinable())
+			worker.join();
+	}
+
+	TrajectoryWorker(const TrajectoryWorker&) = delete;
+	TrajectoryWorker& operator=(const TrajectoryWorker&) = delete;
+
+	// Simulation thread: starts predicting on a newly loaded level, call right after genPhysics()
+	// --------------------------------------------------------------------------------------------
+	void setLevel(const Level& level)
+	{
+		std::shared_ptr<Level> copy = std::make_shared<Level>(level);
+		copy->rebind();
+		this->level = copy;
+		++generation;
+	}
+
+	// Simulation thread: requests the path of the player in the current state of the level
+	// With ensemble set the uncertainty band and hit chance come along
+	// --------------------------------------------------------------------------------------
+	void post(Level& level, const SpaceShip& player, const unsigned int horizon, const bool ensemble = false)
+	{
+		Request& request = requests.getBack();
+		request.level = this->level;
+		request.player = player;
+		request.generation = generation;
+		request.version = level.getStateVersion();
+		request.horizon = horizon;
+		request.ensemble = ensemble;
+		// Moving bodies without an ephemeris can't be replayed cheaply, the worker gets a copy instead
+		if (request.version != 0 && !level.getEphemeris())
+			request.bodies = std::make_shared<const Bodies>(level.getBodies());
+		else
+			request.bodies.reset();
+
+		if (threaded)
+			requests.publish();
+		else
+		{
+			accept(request);
+			slice();
+		}
+	}
+
+	// Simulation thread: generation of the level posted last, compare with Result::generation
+	unsigned int getGeneration() const
+	{
+		return generation;
+	}
+
+	// Render thread: newest samples, may still grow, owned by the caller until the next call
+	// ----------------------------------------------------------------------------------------
+	const Result& read()
+	{
+		return results.read();
+	}
+};
+
+#endif